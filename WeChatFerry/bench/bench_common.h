@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace bench
+{
+
+// 重复 reps 次取最快的一次，单位毫秒
+template <typename F> double best_ms(int reps, F &&run)
+{
+    double best = 1e300;
+    for (int i = 0; i < reps; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+        best = std::min(best, ms.count());
+    }
+    return best;
+}
+
+} // namespace bench
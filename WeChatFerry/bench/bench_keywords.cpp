@@ -0,0 +1,58 @@
+﻿#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "aho_corasick.h"
+#include "bench_common.h"
+
+// 常用汉字区间内的随机字符，UTF-8 编码为 3 字节
+static std::string random_cjk(std::mt19937 &rng, size_t chars)
+{
+    std::string s;
+    for (size_t i = 0; i < chars; i++) {
+        uint32_t cp = 0x4E00 + rng() % 3000;
+        s += static_cast<char>(0xE0 | (cp >> 12));
+        s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        s += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return s;
+}
+
+static void run(size_t words, size_t textBytes)
+{
+    std::mt19937 rng(42);
+    std::vector<std::string> patterns;
+    for (size_t i = 0; i < words; i++) {
+        patterns.push_back(random_cjk(rng, 2 + rng() % 7));
+    }
+    std::string text;
+    while (text.size() < textBytes) {
+        text += random_cjk(rng, 64);
+        text += patterns[rng() % patterns.size()]; // 保证有命中
+    }
+
+    std::unique_ptr<util::AhoCorasick> ac;
+    double buildMs = bench::best_ms(3, [&] { ac = std::make_unique<util::AhoCorasick>(patterns); });
+
+    size_t hits    = 0;
+    double matchMs = bench::best_ms(5, [&] {
+        hits = 0;
+        ac->match(text, [&](uint32_t) { hits++; });
+    });
+
+    double mbps = text.size() / 1e6 / (matchMs / 1e3);
+    printf("%7zu words  build %8.2f ms  %8zu states  scan %6.1f MB/s  (%zu hits in %.1f MB)\n", words, buildMs,
+           ac->states(), mbps, hits, text.size() / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t textBytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16 * 1024 * 1024;
+    for (size_t words : { 100, 1000, 10000, 100000 }) {
+        run(words, textBytes);
+    }
+    return 0;
+}
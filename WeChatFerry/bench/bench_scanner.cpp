@@ -0,0 +1,75 @@
+﻿#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bench_common.h"
+#include "scanner.h"
+
+// 与 contact_manager.cpp 中的地区特征相同
+static const uint8_t FEAT_COUNTRY[]  = { 0xA4, 0xD9, 0x02, 0x4A, 0x18 };
+static const uint8_t FEAT_PROVINCE[] = { 0xE2, 0xEA, 0xA8, 0xD1, 0x18 };
+static const uint8_t FEAT_CITY[]     = { 0x1D, 0x02, 0x5B, 0xBF, 0x18 };
+static const uint8_t *FEATS[]        = { FEAT_COUNTRY, FEAT_PROVINCE, FEAT_CITY };
+static constexpr size_t FEAT_LEN     = 5;
+
+// 原来的实现：每个特征从头逐字节 memcmp 一遍（这里不越过末尾，原实现会多读最多 4 字节）
+static size_t find_mem(const uint8_t *start, const uint8_t *end, const uint8_t *target, size_t len)
+{
+    for (const uint8_t *p = start; p + len <= end; p++) {
+        if (memcmp(p, target, len) == 0) {
+            return static_cast<size_t>(p - start);
+        }
+    }
+    return util::MultiScanner::npos;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+    size_t size  = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2048;
+
+    // 随机数据，特征串放在后半段的随机位置，约十分之一的联系人没有地区
+    std::mt19937 rng(42);
+    std::vector<std::vector<uint8_t>> data(count, std::vector<uint8_t>(size));
+    for (auto &blob : data) {
+        for (auto &b : blob) {
+            b = static_cast<uint8_t>(rng());
+        }
+        if (rng() % 10 == 0) {
+            continue;
+        }
+        for (const uint8_t *feat : FEATS) {
+            size_t at = size / 2 + rng() % (size / 2 - FEAT_LEN);
+            memcpy(blob.data() + at, feat, FEAT_LEN);
+        }
+    }
+
+    std::vector<util::MultiScanner::Blob> blobs;
+    for (const auto &blob : data) {
+        blobs.push_back({ blob.data(), blob.size() });
+    }
+    util::MultiScanner scanner({
+        std::vector<uint8_t>(FEAT_COUNTRY, FEAT_COUNTRY + FEAT_LEN),
+        std::vector<uint8_t>(FEAT_PROVINCE, FEAT_PROVINCE + FEAT_LEN),
+        std::vector<uint8_t>(FEAT_CITY, FEAT_CITY + FEAT_LEN),
+    });
+
+    std::vector<size_t> before(count * 3), after;
+    double oldMs = bench::best_ms(5, [&] {
+        for (size_t b = 0; b < count; b++) {
+            for (size_t i = 0; i < 3; i++) {
+                before[b * 3 + i] = find_mem(blobs[b].data, blobs[b].data + blobs[b].len, FEATS[i], FEAT_LEN);
+            }
+        }
+    });
+    double newMs = bench::best_ms(5, [&] { scanner.scan_batch(blobs, after); });
+
+    bool same = before == after;
+    printf("%zu blobs x %zu bytes\n", count, size);
+    printf("find_mem x3   %8.3f ms\n", oldMs);
+    printf("MultiScanner  %8.3f ms  (%.1fx)\n", newMs, oldMs / newMs);
+    printf("results %s\n", same ? "identical" : "DIFFER");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+﻿// 分块解码语音：按 read_audio 的方式逐块调用 decode_silk_range，拼接后与整条解码比对
+// check_audio_chunks [file.silk ...]，不带参数时用合成的 SILK 分包数据（60 秒）
+// 用桩解码器时要求逐字节一致；用真实解码器时要求长度一致，并给出块边界附近的误差和首块耗时
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "bench_common.h"
+#include "codec.h"
+#include "silk_packets.h"
+
+static constexpr int32_t SAMPLE_RATE = 24000;
+static constexpr size_t CHUNKS[]     = { 250, 37, 1 }; // 默认块大小、不整除的块、逐包
+
+static std::vector<uint8_t> synth_silk(size_t packets)
+{
+    static const char head[] = "\x02#!SILK_V3"; // 和数据库里的原始数据一样带 0x02
+    std::vector<uint8_t> silk(head, head + sizeof(head) - 1);
+
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < packets; i++) {
+        seed       = seed * 1103515245 + 12345;
+        uint16_t n = static_cast<uint16_t>(20 + (seed >> 16) % 60);
+        silk.push_back(static_cast<uint8_t>(n & 0xFF));
+        silk.push_back(static_cast<uint8_t>(n >> 8));
+        for (uint16_t k = 0; k < n; k++) {
+            seed = seed * 1103515245 + 12345;
+            silk.push_back(static_cast<uint8_t>(seed >> 24));
+        }
+    }
+    silk.push_back(0xFF);
+    silk.push_back(0xFF);
+    return silk;
+}
+
+static int16_t sample(const std::vector<uint8_t> &pcm, size_t i)
+{
+    return static_cast<int16_t>(pcm[2 * i] | (pcm[2 * i + 1] << 8));
+}
+
+static bool check(const std::string &name, std::vector<uint8_t> &silk)
+{
+    misc::SilkPackets packets;
+    if (!misc::split_silk(silk, packets) || packets.count() == 0) {
+        printf("%s: 不是 SILK 格式\n", name.c_str());
+        return false;
+    }
+
+    size_t count = packets.count();
+    std::vector<uint8_t> whole;
+    double wholeMs = bench::best_ms(3, [&] { whole = misc::decode_silk_range(silk, packets, 0, count, SAMPLE_RATE); });
+    printf("%s: %zu 包，整条解码 %.1f ms\n", name.c_str(), count, wholeMs);
+
+    bool ok = true;
+    for (size_t chunk : CHUNKS) {
+        std::vector<uint8_t> joined;
+        double firstMs = bench::best_ms(3, [&] { misc::decode_silk_range(silk, packets, 0, chunk, SAMPLE_RATE); });
+        for (size_t begin = 0; begin < count; begin += chunk) {
+            auto pcm = misc::decode_silk_range(silk, packets, begin, begin + chunk, SAMPLE_RATE);
+            joined.insert(joined.end(), pcm.begin(), pcm.end());
+        }
+
+        size_t samples = std::min(whole.size(), joined.size()) / 2;
+        size_t differ  = 0;
+        int maxDiff    = 0;
+        double signal  = 0;
+        double noise   = 0;
+        for (size_t i = 0; i < samples; i++) {
+            int a = sample(whole, i), b = sample(joined, i);
+            differ += a != b;
+            maxDiff = std::max(maxDiff, std::abs(a - b));
+            signal += static_cast<double>(a) * a;
+            noise += static_cast<double>(a - b) * (a - b);
+        }
+
+#ifdef WCF_REAL_CODEC
+        bool pass = whole.size() == joined.size();
+#else
+        bool pass = whole == joined;
+#endif
+        ok = ok && pass;
+        printf("  块 %4zu 包: 首块 %.2f ms，长度 %zu/%zu，不同样本 %zu，最大误差 %d，SNR %s %s\n", chunk, firstMs,
+               joined.size(), whole.size(), differ, maxDiff,
+               noise == 0 ? "inf" : std::to_string(10 * std::log10(signal / noise)).c_str(), pass ? "OK" : "FAIL");
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+#ifdef WCF_REAL_CODEC
+    printf("解码器: smc/Codec.lib\n");
+#else
+    printf("解码器: 桩（只检查分包、预热裁剪和块拼接）\n");
+#endif
+
+    bool ok = true;
+    if (argc < 2) {
+        auto silk = synth_silk(3000);
+        ok        = check("合成数据", silk);
+    }
+    for (int i = 1; i < argc; i++) {
+        std::ifstream in(argv[i], std::ios::binary);
+        std::vector<uint8_t> silk((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        ok = check(argv[i], silk) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+﻿// 没有 smc/Codec.lib 时代替 SilkDecode：每包输出 20ms 的样本，值取本包和上一包的首字节
+// 输出依赖上一包，模拟解码器状态：分块解码不预热时块首对不上整条解码
+#include "codec.h"
+#include "silk_packets.h"
+
+DecTime_t SilkDecode(std::vector<uint8_t> &silk, std::vector<uint8_t> &pcm, int32_t sr)
+{
+    misc::SilkPackets packets;
+    pcm.clear();
+    if (!misc::split_silk(silk, packets)) {
+        return { 0, 0 };
+    }
+
+    size_t samples = static_cast<size_t>(sr) / 50;
+    uint8_t prev   = 0;
+    for (size_t i = 0; i < packets.count(); i++) {
+        size_t pos    = packets.offsets[i] + 2;
+        uint8_t cur   = pos < packets.offsets[i + 1] ? silk[pos] : 0;
+        int16_t value = static_cast<int16_t>(cur * 64 + prev);
+        for (size_t s = 0; s < samples; s++) {
+            pcm.push_back(static_cast<uint8_t>(value & 0xFF));
+            pcm.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+        }
+        prev = cur;
+    }
+    return { packets.count() * 0.02, static_cast<int32_t>(packets.count()) };
+}
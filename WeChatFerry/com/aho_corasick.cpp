@@ -0,0 +1,93 @@
+﻿#include "aho_corasick.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace util
+{
+
+AhoCorasick::AhoCorasick(const std::vector<std::string> &patterns) : patterns_(patterns.size())
+{
+    // 先用邻接表建 trie，再压平成有序的边数组
+    std::vector<std::vector<Edge>> children(1);
+    nodes_.emplace_back();
+
+    for (uint32_t i = 0; i < patterns.size(); i++) {
+        if (patterns[i].empty()) {
+            continue;
+        }
+
+        uint32_t state = 0;
+        for (unsigned char c : patterns[i]) {
+            auto &kids = children[state];
+            auto it    = std::find_if(kids.begin(), kids.end(), [c](const Edge &e) { return e.byte == c; });
+            if (it != kids.end()) {
+                state = it->target;
+                continue;
+            }
+            uint32_t next = static_cast<uint32_t>(nodes_.size());
+            kids.push_back({ c, next });
+            nodes_.emplace_back();
+            children.emplace_back();
+            state = next;
+        }
+        if (nodes_[state].out == NONE) {
+            nodes_[state].out = i;
+        }
+    }
+
+    for (uint32_t s = 0; s < nodes_.size(); s++) {
+        auto &kids = children[s];
+        std::sort(kids.begin(), kids.end(), [](const Edge &a, const Edge &b) { return a.byte < b.byte; });
+        nodes_[s].edgeBegin = static_cast<uint32_t>(edgeBytes_.size());
+        for (const Edge &e : kids) {
+            edgeBytes_.push_back(e.byte);
+            edgeTargets_.push_back(e.target);
+        }
+        nodes_[s].edgeEnd = static_cast<uint32_t>(edgeBytes_.size());
+        std::vector<Edge>().swap(kids);
+    }
+
+    for (uint32_t e = nodes_[0].edgeBegin; e < nodes_[0].edgeEnd; e++) {
+        root_[edgeBytes_[e]] = edgeTargets_[e];
+    }
+
+    // 按层计算 fail 和 dict，浅层节点总是先算好
+    std::queue<uint32_t> bfs;
+    for (uint32_t e = nodes_[0].edgeBegin; e < nodes_[0].edgeEnd; e++) {
+        bfs.push(edgeTargets_[e]);
+    }
+    while (!bfs.empty()) {
+        uint32_t u = bfs.front();
+        bfs.pop();
+        for (uint32_t e = nodes_[u].edgeBegin; e < nodes_[u].edgeEnd; e++) {
+            uint32_t v     = edgeTargets_[e];
+            uint32_t f     = step(nodes_[u].fail, edgeBytes_[e]);
+            nodes_[v].fail = f;
+            nodes_[v].dict = (nodes_[f].out != NONE) ? f : nodes_[f].dict;
+            bfs.push(v);
+        }
+    }
+}
+
+uint32_t AhoCorasick::child(uint32_t state, uint8_t c) const
+{
+    const uint8_t *begin = edgeBytes_.data() + nodes_[state].edgeBegin;
+    const uint8_t *end   = edgeBytes_.data() + nodes_[state].edgeEnd;
+    const uint8_t *it    = std::lower_bound(begin, end, c);
+    return (it != end && *it == c) ? edgeTargets_[it - edgeBytes_.data()] : NONE;
+}
+
+uint32_t AhoCorasick::step(uint32_t state, uint8_t c) const
+{
+    while (state != 0) {
+        uint32_t next = child(state, c);
+        if (next != NONE) {
+            return next;
+        }
+        state = nodes_[state].fail;
+    }
+    return root_[c];
+}
+
+} // namespace util
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace util
+{
+
+// 按字节匹配的 Aho-Corasick 自动机，UTF-8 文本可直接使用
+// 建好后只读，可多线程同时匹配；重复的模式串只报告第一个下标
+class AhoCorasick
+{
+public:
+    explicit AhoCorasick(const std::vector<std::string> &patterns);
+
+    size_t size() const { return patterns_; }
+    size_t states() const { return nodes_.size(); }
+
+    // 对每个命中调用 on_match(模式串下标)，同一模式串出现多次会回调多次
+    template <typename F> void match(std::string_view text, F &&on_match) const
+    {
+        uint32_t state = 0;
+        for (unsigned char c : text) {
+            state = step(state, c);
+            for (uint32_t s = (nodes_[state].out != NONE) ? state : nodes_[state].dict; s != 0; s = nodes_[s].dict) {
+                on_match(nodes_[s].out);
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Node {
+        uint32_t edgeBegin = 0; // edgeBytes_/edgeTargets_ 中的子节点区间，按字节有序
+        uint32_t edgeEnd   = 0;
+        uint32_t fail      = 0;
+        uint32_t dict      = 0;    // 沿 fail 链最近的有输出的节点，0 为没有
+        uint32_t out       = NONE; // 以该节点结尾的模式串下标
+    };
+
+    struct Edge {
+        uint8_t byte;
+        uint32_t target;
+    };
+
+    uint32_t child(uint32_t state, uint8_t c) const;
+    uint32_t step(uint32_t state, uint8_t c) const;
+
+    size_t patterns_ = 0;
+    std::vector<Node> nodes_;
+    std::vector<uint8_t> edgeBytes_; // 字节与目标分开存，查找时只扫连续的字节
+    std::vector<uint32_t> edgeTargets_;
+    std::array<uint32_t, 256> root_ {}; // 根节点的转移用直接表，0 表示回到根
+};
+
+} // namespace util
@@ -0,0 +1,133 @@
+﻿#include "md5.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace util
+{
+
+static constexpr uint32_t K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static constexpr uint32_t S[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, // 第 1 轮
+    5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, // 第 2 轮
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, // 第 3 轮
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, // 第 4 轮
+};
+
+static inline uint32_t rotl(uint32_t x, uint32_t n) { return (x << n) | (x >> (32 - n)); }
+
+Md5::Md5() : state_ { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 } { }
+
+void Md5::transform(const uint8_t *block)
+{
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) { // 小端
+        m[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16)
+            | (static_cast<uint32_t>(block[i * 4 + 3]) << 24);
+    }
+
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    for (uint32_t i = 0; i < 64; i++) {
+        uint32_t f, g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t t = d;
+        d          = c;
+        c          = b;
+        b          = b + rotl(a + f + K[i] + m[g], S[i]);
+        a          = t;
+    }
+
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+}
+
+void Md5::update(const void *data, size_t len)
+{
+    auto p      = static_cast<const uint8_t *>(data);
+    size_t used = bytes_ % 64;
+    bytes_ += len;
+
+    if (used > 0) {
+        size_t n = std::min(len, 64 - used);
+        memcpy(buffer_ + used, p, n);
+        p += n;
+        len -= n;
+        if (used + n < 64) {
+            return;
+        }
+        transform(buffer_);
+    }
+    for (; len >= 64; p += 64, len -= 64) {
+        transform(p);
+    }
+    memcpy(buffer_, p, len);
+}
+
+std::string Md5::hex_digest()
+{
+    uint64_t bits   = bytes_ * 8;
+    uint8_t pad[72] = { 0x80 };
+    size_t padLen   = (bytes_ % 64 < 56) ? 56 - bytes_ % 64 : 120 - bytes_ % 64;
+    for (int i = 0; i < 8; i++) {
+        pad[padLen + i] = static_cast<uint8_t>(bits >> (i * 8));
+    }
+    update(pad, padLen + 8);
+
+    static const char *digits = "0123456789abcdef";
+    std::string hex(32, '0');
+    for (int i = 0; i < 16; i++) {
+        uint8_t v      = static_cast<uint8_t>(state_[i / 4] >> ((i % 4) * 8));
+        hex[i * 2]     = digits[v >> 4];
+        hex[i * 2 + 1] = digits[v & 0x0F];
+    }
+    return hex;
+}
+
+std::string md5_file(const std::filesystem::path &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return "";
+    }
+
+    Md5 md5;
+    std::vector<char> buf(1 << 20);
+    while (in) {
+        in.read(buf.data(), buf.size());
+        if (in.gcount() > 0) {
+            md5.update(buf.data(), static_cast<size_t>(in.gcount()));
+        }
+    }
+    if (in.bad()) {
+        return "";
+    }
+    return md5.hex_digest();
+}
+
+} // namespace util
@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace util
+{
+
+// 流式 MD5（RFC 1321），用于校验上传内容、按内容去重；微信消息里的 md5 也是这个算法
+class Md5
+{
+public:
+    Md5();
+
+    void update(const void *data, size_t len);
+    // 32 位小写十六进制，调用后不能再 update
+    std::string hex_digest();
+
+private:
+    void transform(const uint8_t *block);
+
+    uint32_t state_[4];
+    uint64_t bytes_ = 0;
+    uint8_t buffer_[64];
+};
+
+// 计算文件的 MD5，读取失败返回空串
+std::string md5_file(const std::filesystem::path &path);
+
+} // namespace util
@@ -0,0 +1,112 @@
+﻿#include "scanner.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SCANNER_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace util
+{
+
+// 首字节种类太多时，SIMD 比较次数抵不过查表，直接走标量路径
+#define SIMD_MAX_FIRST_BYTES 4
+
+static inline unsigned lowest_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+MultiScanner::MultiScanner(const std::vector<std::vector<uint8_t>> &patterns) : patterns_(patterns)
+{
+    for (uint32_t i = 0; i < patterns_.size(); i++) {
+        if (patterns_[i].empty()) {
+            continue;
+        }
+        auto &bucket = buckets_[patterns_[i][0]];
+        if (bucket.empty()) {
+            firstBytes_.push_back(patterns_[i][0]);
+        }
+        bucket.push_back(i);
+    }
+}
+
+void MultiScanner::scan(const uint8_t *data, size_t len, std::vector<size_t> &hits) const
+{
+    hits.assign(patterns_.size(), npos);
+    scan_into(data, len, hits.data());
+}
+
+void MultiScanner::scan_batch(const std::vector<Blob> &blobs, std::vector<size_t> &hits) const
+{
+    const size_t n = patterns_.size();
+    hits.assign(blobs.size() * n, npos);
+    for (size_t b = 0; b < blobs.size(); b++) {
+        scan_into(blobs[b].data, blobs[b].len, hits.data() + b * n);
+    }
+}
+
+size_t MultiScanner::scan_into(const uint8_t *data, size_t len, size_t *hits) const
+{
+    size_t remaining = firstBytes_.empty() ? 0 : patterns_.size();
+    if (data == nullptr) {
+        return remaining;
+    }
+
+    auto check = [&](size_t pos) {
+        for (uint32_t idx : buckets_[data[pos]]) {
+            const auto &pat = patterns_[idx];
+            if (hits[idx] == npos && pat.size() <= len - pos && memcmp(data + pos, pat.data(), pat.size()) == 0) {
+                hits[idx] = pos;
+                remaining--;
+            }
+        }
+    };
+
+    size_t i = 0;
+#ifdef SCANNER_SSE2
+    if (firstBytes_.size() <= SIMD_MAX_FIRST_BYTES) {
+        __m128i needles[SIMD_MAX_FIRST_BYTES];
+        const size_t nn = firstBytes_.size();
+        for (size_t k = 0; k < nn; k++) {
+            needles[k] = _mm_set1_epi8(static_cast<char>(firstBytes_[k]));
+        }
+
+        for (; remaining > 0 && i + 16 <= len; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            __m128i eq    = _mm_cmpeq_epi8(block, needles[0]);
+            for (size_t k = 1; k < nn; k++) {
+                eq = _mm_or_si128(eq, _mm_cmpeq_epi8(block, needles[k]));
+            }
+
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(eq));
+            while (mask != 0 && remaining > 0) {
+                check(i + lowest_bit(mask));
+                mask &= mask - 1;
+            }
+        }
+    }
+#endif
+
+    // 剩余不足 16 字节的尾部，或首字节种类过多时逐字节查表
+    for (; remaining > 0 && i < len; i++) {
+        if (!buckets_[data[i]].empty()) {
+            check(i);
+        }
+    }
+
+    return remaining;
+}
+
+} // namespace util
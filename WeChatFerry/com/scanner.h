@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace util
+{
+
+// 单次遍历同时查找多个特征串，先用 SIMD 按首字节筛出候选位置，再逐个比对
+class MultiScanner
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct Blob {
+        const uint8_t *data;
+        size_t len;
+    };
+
+    explicit MultiScanner(const std::vector<std::vector<uint8_t>> &patterns);
+
+    size_t size() const { return patterns_.size(); }
+
+    // hits[i] 为第 i 个特征串首次出现的偏移，未找到为 npos；全部找到后提前结束
+    void scan(const uint8_t *data, size_t len, std::vector<size_t> &hits) const;
+
+    // 批量扫描，hits[b * size() + i] 为第 b 块数据中第 i 个特征串的偏移
+    void scan_batch(const std::vector<Blob> &blobs, std::vector<size_t> &hits) const;
+
+private:
+    size_t scan_into(const uint8_t *data, size_t len, size_t *hits) const;
+
+    std::vector<std::vector<uint8_t>> patterns_;
+    std::vector<uint8_t> firstBytes_;                  // 去重后的首字节
+    std::array<std::vector<uint32_t>, 256> buckets_ {}; // 首字节 -> 特征串下标
+};
+
+} // namespace util
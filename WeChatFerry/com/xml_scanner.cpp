@@ -0,0 +1,196 @@
+﻿#include "xml_scanner.h"
+
+#include <cstdlib>
+
+namespace util
+{
+
+static inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+void XmlScanner::skip_past(std::string_view terminator, size_t from)
+{
+    size_t end = src_.find(terminator, from);
+    pos_       = (end == std::string_view::npos) ? src_.size() : end + terminator.size();
+}
+
+XmlScanner::Token XmlScanner::next()
+{
+    if (pendingEnd_) {
+        pendingEnd_ = false;
+        return Token::EndTag;
+    }
+
+    while (pos_ < src_.size()) {
+        if (src_[pos_] != '<') {
+            size_t end = src_.find('<', pos_);
+            if (end == std::string_view::npos) {
+                end = src_.size();
+            }
+            text_  = src_.substr(pos_, end - pos_);
+            cdata_ = false;
+            pos_   = end;
+            return Token::Text;
+        }
+
+        if (starts_with("<![CDATA[")) {
+            size_t start = pos_ + 9;
+            size_t end   = src_.find("]]>", start);
+            if (end == std::string_view::npos) {
+                end = src_.size();
+            }
+            text_  = src_.substr(start, end - start);
+            cdata_ = true;
+            pos_   = (end == src_.size()) ? end : end + 3;
+            return Token::Text;
+        }
+
+        if (starts_with("<!--")) {
+            skip_past("-->", pos_ + 4);
+            continue;
+        }
+
+        if (starts_with("<?") || starts_with("<!")) {
+            skip_past(">", pos_ + 2);
+            continue;
+        }
+
+        bool closing = (pos_ + 1 < src_.size() && src_[pos_ + 1] == '/');
+        size_t start = pos_ + (closing ? 2 : 1);
+
+        // 找标签结尾，引号内的 '>' 不算
+        size_t i   = start;
+        char quote = 0;
+        for (; i < src_.size(); i++) {
+            char c = src_[i];
+            if (quote) {
+                if (c == quote) quote = 0;
+            } else if (c == '"' || c == '\'') {
+                quote = c;
+            } else if (c == '>') {
+                break;
+            }
+        }
+        if (i >= src_.size()) { // 截断的标签
+            pos_ = src_.size();
+            break;
+        }
+
+        std::string_view body = src_.substr(start, i - start);
+        pos_                  = i + 1;
+
+        bool selfClosing = !closing && !body.empty() && body.back() == '/';
+        if (selfClosing) {
+            body.remove_suffix(1);
+        }
+
+        size_t nameEnd = 0;
+        while (nameEnd < body.size() && !is_space(body[nameEnd])) {
+            nameEnd++;
+        }
+        name_  = body.substr(0, nameEnd);
+        attrs_ = body.substr(nameEnd);
+
+        if (closing) {
+            return Token::EndTag;
+        }
+        pendingEnd_ = selfClosing;
+        return Token::StartTag;
+    }
+
+    return Token::End;
+}
+
+bool XmlScanner::attr(std::string_view key, std::string_view &value) const
+{
+    size_t i = 0, n = attrs_.size();
+    while (i < n) {
+        while (i < n && is_space(attrs_[i])) i++;
+        size_t keyStart = i;
+        while (i < n && attrs_[i] != '=' && !is_space(attrs_[i])) i++;
+        std::string_view k = attrs_.substr(keyStart, i - keyStart);
+
+        while (i < n && is_space(attrs_[i])) i++;
+        if (i >= n || attrs_[i] != '=') {
+            if (k.empty()) break;
+            continue; // 没有值的属性
+        }
+        i++;
+        while (i < n && is_space(attrs_[i])) i++;
+        if (i >= n) break;
+
+        char quote = attrs_[i];
+        size_t valStart, valEnd;
+        if (quote == '"' || quote == '\'') {
+            valStart = i + 1;
+            valEnd   = attrs_.find(quote, valStart);
+            if (valEnd == std::string_view::npos) valEnd = n;
+            i = valEnd + 1;
+        } else {
+            valStart = i;
+            while (i < n && !is_space(attrs_[i])) i++;
+            valEnd = i;
+        }
+
+        if (k == key) {
+            value = attrs_.substr(valStart, valEnd - valStart);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void append_utf8(std::string &out, unsigned long cp)
+{
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x110000) {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+std::string XmlScanner::unescape(std::string_view s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        size_t semi;
+        if (s[i] != '&' || (semi = s.find(';', i)) == std::string_view::npos || semi - i > 10) {
+            out += s[i];
+            continue;
+        }
+
+        std::string_view ent = s.substr(i + 1, semi - i - 1);
+        if (ent == "lt") {
+            out += '<';
+        } else if (ent == "gt") {
+            out += '>';
+        } else if (ent == "amp") {
+            out += '&';
+        } else if (ent == "quot") {
+            out += '"';
+        } else if (ent == "apos") {
+            out += '\'';
+        } else if (ent.size() > 1 && ent[0] == '#') {
+            std::string num(ent.substr(1));
+            bool hex = (num[0] == 'x' || num[0] == 'X');
+            append_utf8(out, std::strtoul(num.c_str() + (hex ? 1 : 0), nullptr, hex ? 16 : 10));
+        } else {
+            out += s[i]; // 不认识的实体原样保留
+            continue;
+        }
+        i = semi;
+    }
+    return out;
+}
+
+} // namespace util
@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace util
+{
+
+// 只读、不分配内存的 XML 拉取式扫描器，只做词法切分，不校验结构
+// 自闭合标签会依次产生 StartTag 和 EndTag；注释、声明、处理指令直接跳过
+class XmlScanner
+{
+public:
+    enum class Token { StartTag, EndTag, Text, End };
+
+    explicit XmlScanner(std::string_view xml) : src_(xml) { }
+
+    Token next();
+
+    // 当前标签名，StartTag / EndTag 有效
+    std::string_view name() const { return name_; }
+
+    // 当前文本，Text 有效；CDATA 原样返回，其余需要 unescape
+    std::string_view text() const { return text_; }
+    bool is_cdata() const { return cdata_; }
+    std::string text_value() const { return cdata_ ? std::string(text_) : unescape(text_); }
+
+    // 读取当前开始标签的属性（未转义），StartTag 有效
+    bool attr(std::string_view key, std::string_view &value) const;
+
+    static std::string unescape(std::string_view s);
+
+private:
+    bool starts_with(std::string_view prefix) const { return src_.compare(pos_, prefix.size(), prefix) == 0; }
+    void skip_past(std::string_view terminator, size_t from);
+
+    std::string_view src_;
+    size_t pos_ = 0;
+    std::string_view name_;
+    std::string_view attrs_;
+    std::string_view text_;
+    bool cdata_      = false;
+    bool pendingEnd_ = false;
+};
+
+} // namespace util
@@ -0,0 +1,115 @@
+﻿#include "xor_cipher.h"
+
+#include <cstring>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define XOR_TARGET_AVX2
+#else
+#define XOR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace util
+{
+
+static bool has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4] = { 0 };
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) { // 系统要保存 YMM 寄存器
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static void xor_scalar(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key)
+{
+    // 先按 8 字节一组处理，编译器不会向量化时也比逐字节快
+    uint64_t wide = 0x0101010101010101ULL * key;
+    size_t i      = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        std::memcpy(&v, src + i, 8);
+        v ^= wide;
+        std::memcpy(dst + i, &v, 8);
+    }
+    for (; i < len; i++) {
+        dst[i] = src[i] ^ key;
+    }
+}
+
+static void xor_sse2(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key)
+{
+    const __m128i k = _mm_set1_epi8(static_cast<char>(key));
+    size_t i        = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(a, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 16), _mm_xor_si128(b, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 32), _mm_xor_si128(c, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 48), _mm_xor_si128(d, k));
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(a, k));
+    }
+    xor_scalar(dst + i, src + i, len - i, key);
+}
+
+XOR_TARGET_AVX2 static void xor_avx2(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key)
+{
+    const __m256i k = _mm256_set1_epi8(static_cast<char>(key));
+    size_t i        = 0;
+    for (; i + 128 <= len; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 96));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 32), _mm256_xor_si256(b, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 64), _mm256_xor_si256(c, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 96), _mm256_xor_si256(d, k));
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(a, k));
+    }
+    _mm256_zeroupper();
+    xor_sse2(dst + i, src + i, len - i, key);
+}
+
+using xor_fn_t = void (*)(uint8_t *, const uint8_t *, size_t, uint8_t);
+
+static xor_fn_t select_kernel()
+{
+    static const xor_fn_t fn = has_avx2() ? xor_avx2 : xor_sse2; // x64 一定有 SSE2
+    return fn;
+}
+
+void xor_copy(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key)
+{
+    if (len == 0) {
+        return;
+    }
+    select_kernel()(dst, src, len, key);
+}
+
+void xor_inplace(uint8_t *data, size_t len, uint8_t key) { xor_copy(data, data, len, key); }
+
+} // namespace util
@@ -0,0 +1,14 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace util
+{
+
+// 单字节密钥异或，微信 .dat 图片就是这么“加密”的
+// 运行时按 CPU 选择 AVX2 / SSE2 实现，尾部不足一个向量的字节走标量
+void xor_inplace(uint8_t *data, size_t len, uint8_t key);
+void xor_copy(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key);
+
+} // namespace util
@@ -0,0 +1,364 @@
+﻿#include "arrow_ipc.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace arrow_ipc
+{
+
+// Arrow 元数据使用 FlatBuffers 编码。这里只需要写，不需要读，所以手写一个从前往后写的精简构造器：
+// 先写父对象并为子对象留出 offset 槽位，子对象写好后再回填。
+class FbBuilder
+{
+public:
+    struct Field {
+        uint16_t id;
+        uint8_t size; // 1/2/4/8，offset 字段为 4
+        uint64_t value;
+        bool isOffset;
+    };
+
+    FbBuilder() { put<uint32_t>(0); } // root offset
+
+    // 写出一张表，offset 字段的槽位按出现顺序放入 slots
+    size_t table(const std::vector<Field> &fields, std::vector<size_t> *slots = nullptr)
+    {
+        std::vector<size_t> order(fields.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return fields[a].size > fields[b].size; });
+
+        uint16_t maxId = 0;
+        size_t maxAlign = 4;
+        std::vector<uint16_t> fieldPos(fields.size());
+        size_t pos = 4; // soffset
+        for (size_t i : order) {
+            pos         = (pos + fields[i].size - 1) / fields[i].size * fields[i].size;
+            fieldPos[i] = static_cast<uint16_t>(pos);
+            pos += fields[i].size;
+            maxId    = std::max(maxId, fields[i].id);
+            maxAlign = std::max<size_t>(maxAlign, fields[i].size);
+        }
+        uint16_t tableSize = static_cast<uint16_t>((pos + 3) / 4 * 4);
+
+        // vtable
+        align(2);
+        size_t vtPos = buf_.size();
+        std::vector<uint16_t> vt(fields.empty() ? 0 : maxId + 1, 0);
+        for (size_t i = 0; i < fields.size(); i++) {
+            vt[fields[i].id] = fieldPos[i];
+        }
+        put<uint16_t>(static_cast<uint16_t>(4 + 2 * vt.size()));
+        put<uint16_t>(tableSize);
+        for (uint16_t v : vt) {
+            put<uint16_t>(v);
+        }
+
+        // table
+        align(maxAlign);
+        size_t tablePos = buf_.size();
+        buf_.resize(tablePos + tableSize, 0);
+        write_at<int32_t>(tablePos, static_cast<int32_t>(tablePos - vtPos));
+        for (size_t i = 0; i < fields.size(); i++) {
+            size_t at = tablePos + fieldPos[i];
+            if (fields[i].isOffset) {
+                if (slots) slots->push_back(at);
+            } else {
+                std::memcpy(&buf_[at], &fields[i].value, fields[i].size);
+            }
+        }
+        return tablePos;
+    }
+
+    size_t string(const std::string &s)
+    {
+        align(4);
+        size_t pos = buf_.size();
+        put<uint32_t>(static_cast<uint32_t>(s.size()));
+        buf_.insert(buf_.end(), s.begin(), s.end());
+        buf_.push_back(0);
+        return pos;
+    }
+
+    // offset 向量，元素槽位放入 slots
+    size_t offset_vector(size_t count, std::vector<size_t> *slots)
+    {
+        align(4);
+        size_t pos = buf_.size();
+        put<uint32_t>(static_cast<uint32_t>(count));
+        for (size_t i = 0; i < count; i++) {
+            slots->push_back(buf_.size());
+            put<uint32_t>(0);
+        }
+        return pos;
+    }
+
+    // 由 int64 组成的结构体向量（FieldNode / Buffer 都是两个 int64）
+    size_t struct_vector(const std::vector<int64_t> &values, size_t fieldsPerStruct)
+    {
+        while ((buf_.size() + 4) % 8) {
+            buf_.push_back(0);
+        }
+        size_t pos = buf_.size();
+        put<uint32_t>(static_cast<uint32_t>(values.size() / fieldsPerStruct));
+        for (int64_t v : values) {
+            put<int64_t>(v);
+        }
+        return pos;
+    }
+
+    void patch(size_t slot, size_t target) { write_at<uint32_t>(slot, static_cast<uint32_t>(target - slot)); }
+
+    std::vector<uint8_t> finish(size_t root)
+    {
+        patch(0, root);
+        align(8);
+        return std::move(buf_);
+    }
+
+private:
+    template <typename T> void put(T v)
+    {
+        size_t pos = buf_.size();
+        buf_.resize(pos + sizeof(T));
+        std::memcpy(&buf_[pos], &v, sizeof(T));
+    }
+
+    template <typename T> void write_at(size_t pos, T v) { std::memcpy(&buf_[pos], &v, sizeof(T)); }
+
+    void align(size_t n)
+    {
+        while (buf_.size() % n) {
+            buf_.push_back(0);
+        }
+    }
+
+    std::vector<uint8_t> buf_;
+};
+
+// Schema.fbs / Message.fbs 中用到的常量
+constexpr int16_t METADATA_V5        = 4;
+constexpr uint8_t HEADER_SCHEMA      = 1;
+constexpr uint8_t HEADER_BATCH       = 3;
+constexpr uint8_t TYPE_INT           = 2;
+constexpr uint8_t TYPE_FLOATINGPOINT = 3;
+constexpr uint8_t TYPE_BINARY        = 4;
+constexpr uint8_t TYPE_UTF8          = 5;
+constexpr int16_t PRECISION_DOUBLE   = 2;
+constexpr uint32_t CONTINUATION      = 0xFFFFFFFF;
+
+static FbBuilder::Field scalar(uint16_t id, uint8_t size, uint64_t value) { return { id, size, value, false }; }
+static FbBuilder::Field offset(uint16_t id) { return { id, 4, 0, true }; }
+
+static bool is_fixed(ColumnType type) { return type == ColumnType::Int64 || type == ColumnType::Double; }
+
+BatchBuilder::BatchBuilder(const std::vector<Column> &schema)
+{
+    for (const auto &col : schema) {
+        columns_.push_back({ col.type });
+    }
+}
+
+void BatchBuilder::set_valid(ColumnData &c, bool valid)
+{
+    if (c.validity.size() * 8 <= rows_) {
+        c.validity.push_back(0);
+    }
+    if (valid) {
+        c.validity[rows_ / 8] |= static_cast<uint8_t>(1 << (rows_ % 8));
+    } else {
+        c.nulls++;
+    }
+}
+
+void BatchBuilder::append_null(size_t col)
+{
+    auto &c = columns_[col];
+    set_valid(c, false);
+    if (is_fixed(c.type)) {
+        c.values.resize(c.values.size() + 8, 0);
+        bodySize_ += 8;
+    } else {
+        c.offsets.push_back(c.offsets.back());
+        bodySize_ += 4;
+    }
+}
+
+void BatchBuilder::append_int64(size_t col, int64_t value)
+{
+    auto &c    = columns_[col];
+    size_t pos = c.values.size();
+    set_valid(c, true);
+    c.values.resize(pos + 8);
+    std::memcpy(&c.values[pos], &value, 8);
+    bodySize_ += 8;
+}
+
+void BatchBuilder::append_double(size_t col, double value)
+{
+    auto &c    = columns_[col];
+    size_t pos = c.values.size();
+    set_valid(c, true);
+    c.values.resize(pos + 8);
+    std::memcpy(&c.values[pos], &value, 8);
+    bodySize_ += 8;
+}
+
+void BatchBuilder::append_bytes(size_t col, const uint8_t *data, size_t len)
+{
+    auto &c = columns_[col];
+    set_valid(c, true);
+    if (len > 0) {
+        c.values.insert(c.values.end(), data, data + len);
+    }
+    c.offsets.push_back(static_cast<int32_t>(c.values.size()));
+    bodySize_ += len + 4;
+}
+
+void BatchBuilder::clear()
+{
+    for (auto &c : columns_) {
+        c.nulls = 0;
+        c.validity.clear();
+        c.values.clear();
+        c.offsets.assign(1, 0);
+    }
+    rows_     = 0;
+    bodySize_ = 0;
+}
+
+void StreamWriter::write_message(const std::vector<uint8_t> &metadata, const std::vector<uint8_t> &body)
+{
+    auto put32 = [&](uint32_t v) {
+        size_t pos = out_.size();
+        out_.resize(pos + 4);
+        std::memcpy(&out_[pos], &v, 4);
+    };
+
+    put32(CONTINUATION);
+    put32(static_cast<uint32_t>(metadata.size())); // FbBuilder 已按 8 字节对齐
+    out_.insert(out_.end(), metadata.begin(), metadata.end());
+    out_.insert(out_.end(), body.begin(), body.end());
+}
+
+void StreamWriter::write_schema(const std::vector<Column> &schema)
+{
+    FbBuilder fb;
+    std::vector<size_t> slots;
+
+    size_t message = fb.table({ scalar(0, 2, METADATA_V5), scalar(1, 1, HEADER_SCHEMA), offset(2), scalar(3, 8, 0) },
+                              &slots);
+    size_t header  = slots.back();
+
+    slots.clear();
+    fb.patch(header, fb.table({ offset(1) }, &slots));
+    size_t fieldsSlot = slots.back();
+
+    std::vector<size_t> fieldSlots;
+    fb.patch(fieldsSlot, fb.offset_vector(schema.size(), &fieldSlots));
+
+    for (size_t i = 0; i < schema.size(); i++) {
+        uint8_t typeType = TYPE_BINARY;
+        switch (schema[i].type) {
+            case ColumnType::Int64:
+                typeType = TYPE_INT;
+                break;
+            case ColumnType::Double:
+                typeType = TYPE_FLOATINGPOINT;
+                break;
+            case ColumnType::Utf8:
+                typeType = TYPE_UTF8;
+                break;
+            case ColumnType::Binary:
+                typeType = TYPE_BINARY;
+                break;
+        }
+
+        // Field { name, nullable, type_type, type, dictionary, children }
+        slots.clear();
+        fb.patch(fieldSlots[i],
+                 fb.table({ offset(0), scalar(1, 1, 1), scalar(2, 1, typeType), offset(3), offset(5) }, &slots));
+        size_t nameSlot = slots[0], typeSlot = slots[1], childrenSlot = slots[2];
+
+        fb.patch(nameSlot, fb.string(schema[i].name));
+        switch (schema[i].type) {
+            case ColumnType::Int64: // Int { bitWidth, is_signed }
+                fb.patch(typeSlot, fb.table({ scalar(0, 4, 64), scalar(1, 1, 1) }));
+                break;
+            case ColumnType::Double: // FloatingPoint { precision }
+                fb.patch(typeSlot, fb.table({ scalar(0, 2, PRECISION_DOUBLE) }));
+                break;
+            default: // Utf8 {} / Binary {}
+                fb.patch(typeSlot, fb.table({}));
+                break;
+        }
+
+        std::vector<size_t> none;
+        fb.patch(childrenSlot, fb.offset_vector(0, &none));
+    }
+
+    write_message(fb.finish(message), {});
+}
+
+void StreamWriter::write_batch(const BatchBuilder &batch)
+{
+    std::vector<uint8_t> body;
+    std::vector<int64_t> nodes;
+    std::vector<int64_t> buffers;
+
+    auto add_buffer = [&](const void *data, size_t len) {
+        buffers.push_back(static_cast<int64_t>(body.size()));
+        buffers.push_back(static_cast<int64_t>(len));
+        if (len > 0) {
+            const uint8_t *p = static_cast<const uint8_t *>(data);
+            body.insert(body.end(), p, p + len);
+        }
+        body.resize((body.size() + 7) / 8 * 8, 0);
+    };
+
+    body.reserve(batch.body_size() + batch.columns_.size() * 32);
+    for (const auto &c : batch.columns_) {
+        nodes.push_back(static_cast<int64_t>(batch.rows_));
+        nodes.push_back(c.nulls);
+
+        if (c.nulls > 0) {
+            add_buffer(c.validity.data(), c.validity.size());
+        } else {
+            add_buffer(nullptr, 0);
+        }
+
+        if (is_fixed(c.type)) {
+            add_buffer(c.values.data(), c.values.size());
+        } else {
+            add_buffer(c.offsets.data(), c.offsets.size() * sizeof(int32_t));
+            add_buffer(c.values.data(), c.values.size());
+        }
+    }
+
+    FbBuilder fb;
+    std::vector<size_t> slots;
+
+    size_t message = fb.table({ scalar(0, 2, METADATA_V5), scalar(1, 1, HEADER_BATCH), offset(2),
+                                scalar(3, 8, static_cast<uint64_t>(body.size())) },
+                              &slots);
+    size_t header  = slots.back();
+
+    // RecordBatch { length, nodes, buffers }
+    slots.clear();
+    fb.patch(header, fb.table({ scalar(0, 8, static_cast<uint64_t>(batch.rows_)), offset(1), offset(2) }, &slots));
+    fb.patch(slots[0], fb.struct_vector(nodes, 2));
+    fb.patch(slots[1], fb.struct_vector(buffers, 2));
+
+    write_message(fb.finish(message), body);
+}
+
+void StreamWriter::write_eos()
+{
+    const uint32_t eos[2] = { CONTINUATION, 0 };
+    const uint8_t *p      = reinterpret_cast<const uint8_t *>(eos);
+    out_.insert(out_.end(), p, p + sizeof(eos));
+}
+
+} // namespace arrow_ipc
@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 精简版 Arrow IPC Stream 写入器，只支持 Int64 / Double / Utf8 / Binary 四种列类型
+// 格式参考：https://arrow.apache.org/docs/format/Columnar.html#ipc-streaming-format
+namespace arrow_ipc
+{
+
+enum class ColumnType { Int64, Double, Utf8, Binary };
+
+struct Column {
+    std::string name;
+    ColumnType type;
+};
+
+// 按列累积一个 RecordBatch
+class BatchBuilder
+{
+public:
+    explicit BatchBuilder(const std::vector<Column> &schema);
+
+    void append_null(size_t col);
+    void append_int64(size_t col, int64_t value);
+    void append_double(size_t col, double value);
+    void append_bytes(size_t col, const uint8_t *data, size_t len);
+    void finish_row() { rows_++; }
+
+    size_t rows() const { return rows_; }
+    size_t body_size() const { return bodySize_; }
+    void clear();
+
+private:
+    friend class StreamWriter;
+
+    struct ColumnData {
+        ColumnType type;
+        int64_t nulls = 0;
+        std::vector<uint8_t> validity {};
+        std::vector<uint8_t> values {};     // Int64/Double 的定长值，或者 Utf8/Binary 的数据区
+        std::vector<int32_t> offsets { 0 }; // 仅 Utf8/Binary 使用
+    };
+
+    void set_valid(ColumnData &c, bool valid);
+
+    size_t rows_     = 0;
+    size_t bodySize_ = 0;
+    std::vector<ColumnData> columns_;
+};
+
+class StreamWriter
+{
+public:
+    explicit StreamWriter(std::vector<uint8_t> &out) : out_(out) { }
+
+    void write_schema(const std::vector<Column> &schema);
+    void write_batch(const BatchBuilder &batch);
+    void write_eos();
+
+private:
+    void write_message(const std::vector<uint8_t> &metadata, const std::vector<uint8_t> &body);
+
+    std::vector<uint8_t> &out_;
+};
+
+} // namespace arrow_ipc
@@ -1,12 +1,24 @@
 #pragma once
 
 #include <map>
+#include <optional>
 #include <string>
 #include <vector>
 
 using namespace std;
 
 typedef map<int, string> MsgTypes_t;
+typedef map<string, uint64_t> Stats_t;
+
+// 字段掩码，第 n 位对应字段编号 n + 1，0 为全部字段
+typedef uint32_t FieldMask_t;
+inline bool has_field(FieldMask_t mask, uint32_t tag) { return mask == 0 || (mask & (1u << (tag - 1))) != 0; }
+
+// 带字段掩码的列表，用于编码回调
+template <typename T> struct Masked_t {
+    const T &data;
+    FieldMask_t mask;
+};
 
 typedef struct {
     int32_t gender;
@@ -21,6 +33,13 @@ typedef struct {
 
 typedef vector<string> DbNames_t;
 
+typedef struct {
+    uint64_t version;
+    bool full;
+    vector<RpcContact_t> contacts;
+    vector<string> removed;
+} ContactsDelta_t;
+
 typedef struct {
     string name;
     string sql;
@@ -35,6 +54,101 @@ typedef struct {
 typedef vector<DbField_t> DbRow_t;
 typedef vector<DbRow_t> DbRows_t;
 
+typedef struct {
+    int32_t type; // RoomEvent_Type
+    vector<string> wxids;
+    uint32_t count;
+} RoomEvent_t;
+
+typedef struct {
+    vector<string> at_users;
+    uint64_t quoted_id;
+    uint32_t app_type;
+    string title;
+    string url;
+    string md5;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+} MsgFields_t;
+
+typedef struct {
+    uint64_t job;
+    int32_t func; // Functions
+    string receiver;
+    int32_t state; // SendResult_State
+    int32_t status;
+    uint32_t wait_ms;
+    uint32_t run_ms;
+} SendResult_t;
+
+typedef struct {
+    uint32_t total;
+    uint32_t done;
+    uint32_t decrypted;
+    uint32_t skipped;
+    uint32_t failed;
+    uint64_t bytes;
+    uint32_t elapsed_ms;
+    vector<string> errors;
+    uint64_t batch;
+    bool finished;
+} DecProgress_t;
+
+typedef struct {
+    string format;
+    uint64_t total;
+    uint64_t offset;
+    vector<uint8_t> data;
+} ImageData_t;
+
+typedef struct {
+    vector<uint8_t> ipc;
+    bool truncated;
+    uint64_t next_offset;
+} ArrowData_t;
+
+typedef struct {
+    int32_t format; // AudioRange_Format
+    int32_t sr;
+    uint32_t frame;
+    uint32_t next;
+    uint32_t total;
+    vector<uint8_t> data;
+} AudioData_t;
+
+typedef struct {
+    uint64_t id;
+    string path;
+    uint32_t ms;
+    uint64_t job;
+} AudioResult_t;
+
+typedef struct {
+    uint64_t job;
+    uint32_t total;
+    bool finished;
+    vector<AudioResult_t> results;
+} AudioResults_t;
+
+typedef struct {
+    uint64_t job;
+    uint64_t id;
+    string path;
+    uint64_t size;
+    int32_t state; // DownloadResult_State
+    int32_t status;
+    uint32_t wait_ms;
+    uint32_t run_ms;
+} DownloadResult_t;
+
+typedef struct {
+    int32_t status;
+    string handle;
+    uint64_t received;
+    bool done;
+} UploadState_t;
+
 typedef struct {
     bool is_self;
     bool is_group;
@@ -48,8 +162,24 @@ typedef struct {
     string thumb;
     string extra;
     string xml;
+    optional<RoomEvent_t> event;
+    string sender_name;
+    string room_alias;
+    optional<MsgFields_t> fields;
+    vector<uint32_t> rule_ids;
+    optional<SendResult_t> sent;
+    optional<DecProgress_t> dec;
+    optional<AudioResult_t> audio;
+    optional<DownloadResult_t> dl;
 } WxMsg_t;
 
+// 服务端生成的通知（群事件、发送结果、解密进度、语音、下载结果），不是微信消息
+inline bool is_notice(const WxMsg_t &msg)
+{
+    return msg.event.has_value() || msg.sent.has_value() || msg.dec.has_value() || msg.audio.has_value()
+        || msg.dl.has_value();
+}
+
 typedef struct {
     string wxid;
     string name;
@@ -61,3 +191,16 @@ typedef struct {
     int32_t status;
     string result;
 } OcrResult_t;
+
+typedef struct {
+    string wxid;
+    string name;  // 联系人昵称
+    string alias; // 群昵称
+} RoomMember_t;
+
+typedef struct {
+    string roomid;
+    vector<RoomMember_t> members;
+    vector<string> admins;
+} RoomMembers_t;
+typedef vector<RoomMembers_t> RoomMembersList_t;
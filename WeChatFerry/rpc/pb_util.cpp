@@ -63,34 +63,53 @@ bool encode_types(pb_ostream_t *stream, const pb_field_t *field, void *const *ar
     return true;
 }
 
-bool encode_contacts(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
+bool encode_stats(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
 {
-    vector<RpcContact_t> *v = (vector<RpcContact_t> *)*arg;
-    RpcContact message      = RpcContact_init_default;
-
-    for (auto it = v->begin(); it != v->end(); it++) {
-        message.wxid.funcs.encode = &encode_string;
-        message.wxid.arg          = (void *)(*it).wxid.c_str();
+    Stats_t *m                = (Stats_t *)*arg;
+    Stats_ValuesEntry message = Stats_ValuesEntry_init_default;
 
-        message.code.funcs.encode = &encode_string;
-        message.code.arg          = (void *)(*it).code.c_str();
+    for (auto it = m->begin(); it != m->end(); it++) {
+        message.key.funcs.encode = &encode_string;
+        message.key.arg          = (void *)it->first.c_str();
+        message.value            = it->second;
 
-        message.remark.funcs.encode = &encode_string;
-        message.remark.arg          = (void *)(*it).remark.c_str();
+        if (!pb_encode_tag_for_field(stream, field)) {
+            LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
+            return false;
+        }
 
-        message.name.funcs.encode = &encode_string;
-        message.name.arg          = (void *)(*it).name.c_str();
+        if (!pb_encode_submessage(stream, Stats_ValuesEntry_fields, &message)) {
+            LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
+            return false;
+        }
+    }
 
-        message.country.funcs.encode = &encode_string;
-        message.country.arg          = (void *)(*it).country.c_str();
+    return true;
+}
 
-        message.province.funcs.encode = &encode_string;
-        message.province.arg          = (void *)(*it).province.c_str();
+bool encode_contacts(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
+{
+    auto *m            = (Masked_t<vector<RpcContact_t>> *)*arg;
+    RpcContact message = RpcContact_init_default;
+
+    // 未请求的字段不设置回调，nanopb 不会编码
+    auto set_string = [&](pb_callback_t &cb, uint32_t tag, const string &value) {
+        if (has_field(m->mask, tag)) {
+            cb.funcs.encode = &encode_string;
+            cb.arg          = (void *)value.c_str();
+        }
+    };
 
-        message.city.funcs.encode = &encode_string;
-        message.city.arg          = (void *)(*it).city.c_str();
+    for (auto it = m->data.begin(); it != m->data.end(); it++) {
+        set_string(message.wxid, RpcContact_wxid_tag, (*it).wxid);
+        set_string(message.code, RpcContact_code_tag, (*it).code);
+        set_string(message.remark, RpcContact_remark_tag, (*it).remark);
+        set_string(message.name, RpcContact_name_tag, (*it).name);
+        set_string(message.country, RpcContact_country_tag, (*it).country);
+        set_string(message.province, RpcContact_province_tag, (*it).province);
+        set_string(message.city, RpcContact_city_tag, (*it).city);
 
-        message.gender = (*it).gender;
+        message.gender = has_field(m->mask, RpcContact_gender_tag) ? (*it).gender : 0;
 
         if (!pb_encode_tag_for_field(stream, field)) {
             LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
@@ -106,9 +125,9 @@ bool encode_contacts(pb_ostream_t *stream, const pb_field_t *field, void *const
     return true;
 }
 
-bool encode_dbnames(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
+bool encode_strings(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
 {
-    DbNames_t *v = (DbNames_t *)*arg;
+    auto *v = (vector<string> *)*arg;
     for (auto it = v->begin(); it != v->end(); it++) {
         if (!pb_encode_tag_for_field(stream, field)) {
             LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
@@ -124,17 +143,26 @@ bool encode_dbnames(pb_ostream_t *stream, const pb_field_t *field, void *const *
     return true;
 }
 
+bool encode_dbnames(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
+{
+    return encode_strings(stream, field, arg);
+}
+
 bool encode_tables(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
 {
-    DbTables_t *v   = (DbTables_t *)*arg;
+    auto *m         = (Masked_t<DbTables_t> *)*arg;
     DbTable message = DbTable_init_default;
 
-    for (auto it = v->begin(); it != v->end(); it++) {
-        message.name.funcs.encode = &encode_string;
-        message.name.arg          = (void *)(*it).name.c_str();
+    for (auto it = m->data.begin(); it != m->data.end(); it++) {
+        if (has_field(m->mask, DbTable_name_tag)) {
+            message.name.funcs.encode = &encode_string;
+            message.name.arg          = (void *)(*it).name.c_str();
+        }
 
-        message.sql.funcs.encode = &encode_string;
-        message.sql.arg          = (void *)(*it).sql.c_str();
+        if (has_field(m->mask, DbTable_sql_tag)) {
+            message.sql.funcs.encode = &encode_string;
+            message.sql.arg          = (void *)(*it).sql.c_str();
+        }
 
         if (!pb_encode_tag_for_field(stream, field)) {
             LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
@@ -152,17 +180,21 @@ bool encode_tables(pb_ostream_t *stream, const pb_field_t *field, void *const *a
 
 static bool encode_fields(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
 {
-    DbRow_t *v      = (DbRow_t *)*arg;
+    auto *m         = (Masked_t<DbRow_t> *)*arg;
     DbField message = DbField_init_default;
 
-    for (auto it = v->begin(); it != v->end(); it++) {
-        message.type = (*it).type;
+    for (auto it = m->data.begin(); it != m->data.end(); it++) {
+        message.type = has_field(m->mask, DbField_type_tag) ? (*it).type : 0;
 
-        message.column.arg          = (void *)(*it).column.c_str();
-        message.column.funcs.encode = &encode_string;
+        if (has_field(m->mask, DbField_column_tag)) {
+            message.column.arg          = (void *)(*it).column.c_str();
+            message.column.funcs.encode = &encode_string;
+        }
 
-        message.content.arg          = (void *)&(*it).content;
-        message.content.funcs.encode = &encode_bytes;
+        if (has_field(m->mask, DbField_content_tag)) {
+            message.content.arg          = (void *)&(*it).content;
+            message.content.funcs.encode = &encode_bytes;
+        }
 
         if (!pb_encode_tag_for_field(stream, field)) {
             LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
@@ -180,11 +212,12 @@ static bool encode_fields(pb_ostream_t *stream, const pb_field_t *field, void *c
 
 bool encode_rows(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
 {
-    DbRows_t *v   = (DbRows_t *)*arg;
+    auto *m       = (Masked_t<DbRows_t> *)*arg;
     DbRow message = DbRow_init_default;
 
-    for (auto it = v->begin(); it != v->end(); it++) {
-        message.fields.arg          = (void *)&(*it);
+    for (auto it = m->data.begin(); it != m->data.end(); it++) {
+        Masked_t<DbRow_t> row       = { *it, m->mask };
+        message.fields.arg          = (void *)&row;
         message.fields.funcs.encode = &encode_fields;
 
         if (!pb_encode_tag_for_field(stream, field)) {
@@ -200,3 +233,57 @@ bool encode_rows(pb_ostream_t *stream, const pb_field_t *field, void *const *arg
 
     return true;
 }
+
+static bool encode_room_members(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
+{
+    auto *v            = (vector<RoomMember_t> *)*arg;
+    RoomMember message = RoomMember_init_default;
+
+    for (auto it = v->begin(); it != v->end(); it++) {
+        message.wxid.funcs.encode  = &encode_string;
+        message.wxid.arg           = (void *)(*it).wxid.c_str();
+        message.name.funcs.encode  = &encode_string;
+        message.name.arg           = (void *)(*it).name.c_str();
+        message.alias.funcs.encode = &encode_string;
+        message.alias.arg          = (void *)(*it).alias.c_str();
+
+        if (!pb_encode_tag_for_field(stream, field)) {
+            LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
+            return false;
+        }
+
+        if (!pb_encode_submessage(stream, RoomMember_fields, &message)) {
+            LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool encode_rooms(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
+{
+    auto *v             = (RoomMembersList_t *)*arg;
+    RoomMembers message = RoomMembers_init_default;
+
+    for (auto it = v->begin(); it != v->end(); it++) {
+        message.roomid.funcs.encode  = &encode_string;
+        message.roomid.arg           = (void *)(*it).roomid.c_str();
+        message.members.funcs.encode = &encode_room_members;
+        message.members.arg          = (void *)&(*it).members;
+        message.admins.funcs.encode  = &encode_strings;
+        message.admins.arg           = (void *)&(*it).admins;
+
+        if (!pb_encode_tag_for_field(stream, field)) {
+            LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
+            return false;
+        }
+
+        if (!pb_encode_submessage(stream, RoomMembers_fields, &message)) {
+            LOG_ERROR("Encoding failed: {}", PB_GET_ERROR(stream));
+            return false;
+        }
+    }
+
+    return true;
+}
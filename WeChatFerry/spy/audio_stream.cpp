@@ -0,0 +1,339 @@
+﻿#include "audio_stream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "codec.h"
+#include "database_executor.h"
+#include "log.hpp"
+#include "message_handler.h"
+#include "misc_manager.h"
+#include "pb_util.h"
+#include "rpc_helper.h"
+
+namespace misc
+{
+
+static constexpr int32_t DEFAULT_SAMPLE_RATE = 24000;
+static constexpr uint32_t DEFAULT_FRAMES     = 250; // 5 秒
+static constexpr uint32_t MAX_FRAMES         = 3000;
+static constexpr size_t MAX_AUDIO_WORKERS    = 16;
+static constexpr size_t MAX_AUDIO_JOBS       = 4;   // 同时运行的批次
+static constexpr size_t MAX_AUDIO_RESULTS    = 16;  // 保留结果的已结束批次
+static constexpr size_t AUDIO_GROUP_SIZE     = 500; // 每组取一次数据，转完释放再取下一组
+
+static bool is_valid_sample_rate(int32_t sr)
+{
+    static constexpr int32_t rates[] = { 8000, 12000, 16000, 24000, 32000, 44100, 48000 };
+    return std::find(std::begin(rates), std::end(rates), sr) != std::end(rates);
+}
+
+// 客户端一般按顺序取完一条语音，记住最近一条，免得每块都去各个 MediaMSG 库里查一遍
+static std::mutex lastMutex;
+static uint64_t lastId = 0;
+static std::shared_ptr<const std::vector<uint8_t>> lastSilk;
+static SilkPackets lastPackets;
+
+static bool load_silk(uint64_t id, std::shared_ptr<const std::vector<uint8_t>> &silk, SilkPackets &packets)
+{
+    {
+        std::lock_guard<std::mutex> lock(lastMutex);
+        if (lastSilk && lastId == id) {
+            silk    = lastSilk;
+            packets = lastPackets;
+            return true;
+        }
+    }
+
+    auto data = std::make_shared<std::vector<uint8_t>>(db::get_audio_data(id));
+    if (data->empty()) {
+        LOG_ERROR("没有获取到语音数据.");
+        return false;
+    }
+    if (!split_silk(*data, packets)) {
+        LOG_ERROR("不是 SILK 格式: {}", id);
+        return false;
+    }
+    silk = data;
+
+    std::lock_guard<std::mutex> lock(lastMutex);
+    lastId      = id;
+    lastSilk    = silk;
+    lastPackets = packets;
+    return true;
+}
+
+AudioData_t read_audio(uint64_t id, int32_t format, int32_t sr, uint32_t frame, uint32_t frames)
+{
+    AudioData_t audio = {};
+    audio.format      = format;
+    audio.sr          = sr ? sr : DEFAULT_SAMPLE_RATE;
+    if (!is_valid_sample_rate(audio.sr)) {
+        LOG_ERROR("不支持的采样率: {}", sr);
+        return audio;
+    }
+
+    std::shared_ptr<const std::vector<uint8_t>> silk;
+    SilkPackets packets;
+    if (!load_silk(id, silk, packets)) {
+        return audio;
+    }
+
+    size_t total = packets.count();
+    size_t begin = std::min<size_t>(frame, total);
+    size_t end   = std::min<size_t>(begin + (frames ? std::min(frames, MAX_FRAMES) : DEFAULT_FRAMES), total);
+    audio.total  = static_cast<uint32_t>(total);
+    audio.frame  = static_cast<uint32_t>(begin);
+    audio.next   = static_cast<uint32_t>(end);
+    if (begin == end) {
+        return audio;
+    }
+
+    std::vector<uint8_t> pcm = decode_silk_range(*silk, packets, begin, end, audio.sr);
+    // MP3 每块单独编码，块首有编码器延迟、块尾有补齐的静音，拼接后在块边界有短暂空隙；要无缝拼接用 PCM
+    if (format == AudioRange_Format_MP3) {
+        Mp3Encode(pcm, audio.data, audio.sr);
+    } else {
+        audio.data = std::move(pcm);
+    }
+    return audio;
+}
+
+// 请求里的数据在 RPC 返回后就释放了，后台批次用自己的副本
+struct AudioJob {
+    uint64_t id;
+    std::vector<uint64_t> ids;
+    std::filesystem::path dir;
+    std::string ext;
+    int32_t sr;
+    uint32_t workers;
+    std::thread thread;
+    std::atomic<bool> cancel { false };
+    std::vector<AudioResult_t> results; // 以下受 jobMutex 保护
+    bool finished = false;
+};
+
+static std::mutex jobMutex;
+static std::map<uint64_t, std::unique_ptr<AudioJob>> jobs; // 运行中和最近结束的批次
+static uint64_t nextJob = 1;
+static bool jobsStopped = false;
+
+static void run_audio_job(AudioJob &job)
+{
+    namespace fs = std::filesystem;
+
+    auto publish = [&](AudioResult_t result) {
+        result.job    = job.id;
+        auto &handler = message::Handler::getInstance();
+        if (handler.isMessageListening()) {
+            WxMsg_t msg = {};
+            msg.type    = AUDIO_RESULT_MSG_TYPE;
+            msg.ts      = static_cast<uint32_t>(time(nullptr));
+            msg.audio   = result;
+            handler.pushMessage(std::move(msg));
+        }
+        std::lock_guard<std::mutex> lock(jobMutex);
+        job.results.push_back(std::move(result));
+    };
+
+    // 已经保存过的直接返回，剩下的一次性从各个库里取出
+    std::error_code ec;
+    fs::create_directories(job.dir, ec);
+    std::vector<uint64_t> ids;
+    for (uint64_t id : job.ids) {
+        fs::path path = job.dir / (std::to_string(id) + job.ext);
+        if (fs::exists(path, ec)) {
+            publish({ id, path.generic_string(), 0 });
+        } else {
+            ids.push_back(id);
+        }
+    }
+
+    // 分组取出、转码，整批的语音数据不会同时留在内存里
+    size_t nworkers = job.workers ? job.workers : std::thread::hardware_concurrency();
+    nworkers        = std::clamp<size_t>(nworkers, 1, MAX_AUDIO_WORKERS);
+    for (size_t from = 0; from < ids.size(); from += AUDIO_GROUP_SIZE) {
+        std::vector<uint64_t> group(ids.begin() + from, ids.begin() + std::min(ids.size(), from + AUDIO_GROUP_SIZE));
+        auto silks = job.cancel ? std::unordered_map<uint64_t, std::vector<uint8_t>> {} : db::get_audio_data(group);
+        std::vector<uint64_t> found;
+        for (uint64_t id : group) {
+            if (silks.find(id) == silks.end()) {
+                if (!job.cancel) LOG_ERROR("没有获取到语音数据: {}", id);
+                publish({ id, "", 0 });
+            } else {
+                found.push_back(id);
+            }
+        }
+
+        std::atomic<size_t> next { 0 };
+        auto worker = [&]() {
+            for (size_t i = next++; i < found.size(); i = next++) {
+                uint64_t id  = found[i];
+                auto started = std::chrono::steady_clock::now();
+                std::string path;
+                try {
+                    if (!job.cancel) {
+                        path = save_audio(id, silks.at(id), job.dir / (std::to_string(id) + job.ext), job.sr);
+                    }
+                } catch (const std::exception &e) {
+                    LOG_ERROR("转码失败: {}, {}", id, e.what());
+                }
+                auto elapsed = std::chrono::steady_clock::now() - started;
+                auto ms      = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+                publish({ id, std::move(path), static_cast<uint32_t>(ms.count()) });
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < std::min(nworkers, found.size()); i++) {
+            threads.emplace_back(worker);
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(jobMutex);
+    job.finished = true;
+    LOG_INFO("批量语音 {} 完成: 共 {}，已保存 {}", job.id, job.ids.size(),
+             std::count_if(job.results.begin(), job.results.end(), [](const auto &r) { return !r.path.empty(); }));
+}
+
+// 调用方持有 jobMutex；结束的批次只保留最近几个，线程已退出，join 不会等
+static void reap_audio_jobs()
+{
+    size_t finished = 0;
+    for (const auto &[id, j] : jobs) {
+        finished += j->finished ? 1 : 0;
+    }
+    for (auto it = jobs.begin(); it != jobs.end() && finished > MAX_AUDIO_RESULTS;) {
+        if (!it->second->finished) {
+            ++it;
+            continue;
+        }
+        if (it->second->thread.joinable()) {
+            it->second->thread.join();
+        }
+        it = jobs.erase(it);
+        finished--;
+    }
+}
+
+uint64_t get_audios(const AudioBatch &ab)
+{
+    int32_t sr = ab.sr ? ab.sr : DEFAULT_SAMPLE_RATE;
+    if (!ab.dir || !*ab.dir || !is_valid_sample_rate(sr)) {
+        LOG_ERROR("参数错误: dir={}, sr={}", ab.dir ? ab.dir : "", sr);
+        return 0;
+    }
+
+    // 重复的 id 只保留第一个，否则会有两个线程同时写同一个文件
+    auto job = std::make_unique<AudioJob>();
+    std::unordered_set<uint64_t> seen;
+    for (size_t i = 0; i < ab.ids_count; i++) {
+        if (seen.insert(ab.ids[i]).second) {
+            job->ids.push_back(ab.ids[i]);
+        }
+    }
+    job->dir     = std::filesystem::path(ab.dir);
+    job->ext     = ab.format == AudioRange_Format_MP3 ? ".mp3" : ".pcm";
+    job->sr      = sr;
+    job->workers = ab.workers;
+
+    std::lock_guard<std::mutex> lock(jobMutex);
+    reap_audio_jobs();
+    size_t running = std::count_if(jobs.begin(), jobs.end(), [](const auto &j) { return !j.second->finished; });
+    if (jobsStopped || running >= MAX_AUDIO_JOBS) {
+        LOG_ERROR("无法启动批量语音: 已停止或同时运行的批次太多 ({})", running);
+        return 0;
+    }
+
+    job->id     = nextJob++;
+    AudioJob *j = job.get();
+    j->thread   = std::thread([j]() { run_audio_job(*j); });
+    jobs.emplace(j->id, std::move(job));
+    return j->id;
+}
+
+AudioResults_t query_audios(uint64_t job)
+{
+    std::lock_guard<std::mutex> lock(jobMutex);
+    auto it = jobs.find(job);
+    if (it == jobs.end()) {
+        return {};
+    }
+    const AudioJob &j = *it->second;
+    return { j.id, static_cast<uint32_t>(j.ids.size()), j.finished, j.results };
+}
+
+void stop_audios()
+{
+    std::map<uint64_t, std::unique_ptr<AudioJob>> stopping;
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobsStopped = true;
+        stopping.swap(jobs);
+    }
+    for (auto &[id, j] : stopping) {
+        j->cancel = true;
+        if (j->thread.joinable()) {
+            j->thread.join();
+        }
+    }
+}
+
+bool rpc_read_audio(const AudioRange &ar, uint8_t *out, size_t *len)
+{
+    AudioData_t audio = read_audio(ar.id, ar.format, ar.sr, ar.frame, ar.frames);
+    return fill_response<Functions_FUNC_READ_AUDIO>(out, len, [&](Response &rsp) {
+        rsp.msg.audio.format            = static_cast<AudioRange_Format>(audio.format);
+        rsp.msg.audio.sr                = audio.sr;
+        rsp.msg.audio.frame             = audio.frame;
+        rsp.msg.audio.next              = audio.next;
+        rsp.msg.audio.total             = audio.total;
+        rsp.msg.audio.data.funcs.encode = encode_bytes;
+        rsp.msg.audio.data.arg          = &audio.data;
+    });
+}
+
+static bool fill_audio_results(Functions func, AudioResults_t &results, uint8_t *out, size_t *len)
+{
+    std::vector<AudioResult> items(results.results.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        items[i].id   = results.results[i].id;
+        items[i].path = const_cast<char *>(results.results[i].path.c_str());
+        items[i].ms   = results.results[i].ms;
+        items[i].job  = results.results[i].job;
+    }
+
+    auto fill = [&](Response &rsp) {
+        rsp.msg.audios.results_count = static_cast<pb_size_t>(items.size());
+        rsp.msg.audios.results       = items.data();
+        rsp.msg.audios.job           = results.job;
+        rsp.msg.audios.total         = results.total;
+        rsp.msg.audios.finished      = results.finished;
+    };
+    return func == Functions_FUNC_GET_AUDIO_MSGS ? fill_response<Functions_FUNC_GET_AUDIO_MSGS>(out, len, fill)
+                                                 : fill_response<Functions_FUNC_GET_AUDIO_JOB>(out, len, fill);
+}
+
+bool rpc_get_audios(const AudioBatch &ab, uint8_t *out, size_t *len)
+{
+    AudioResults_t results = query_audios(get_audios(ab)); // 总数按去重后的 id 计
+    return fill_audio_results(Functions_FUNC_GET_AUDIO_MSGS, results, out, len);
+}
+
+bool rpc_query_audios(uint64_t job, uint8_t *out, size_t *len)
+{
+    AudioResults_t results = query_audios(job);
+    return fill_audio_results(Functions_FUNC_GET_AUDIO_JOB, results, out, len);
+}
+
+} // namespace misc
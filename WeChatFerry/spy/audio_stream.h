@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "wcf.pb.h"
+
+#include "pb_types.h"
+#include "silk_packets.h"
+
+namespace misc
+{
+
+// 只解码请求的那几个包，首包延迟与语音总长无关；PCM 按顺序拼接即为完整语音，MP3 每块是独立的片段，块边界有空隙
+AudioData_t read_audio(uint64_t id, int32_t format, int32_t sr, uint32_t frame, uint32_t frames);
+
+// 批量语音结果的消息类型
+constexpr uint32_t AUDIO_RESULT_MSG_TYPE = 0x10003;
+
+// 在后台一次取出所有语音数据，在线程池里转码保存到目录，立即返回批次 id，参数错误或同时运行的批次太多时返回 0
+// 每完成一条以 AUDIO_RESULT_MSG_TYPE 消息推送（需开启消息接收），也可用 query_audios 查询
+uint64_t get_audios(const AudioBatch &ab);
+// 已完成的结果按完成顺序排列；未知或已淘汰的批次 job 为 0
+AudioResults_t query_audios(uint64_t job);
+// 取消并等待所有批次，之后不再接受新批次
+void stop_audios();
+
+// RPC 方法
+bool rpc_read_audio(const AudioRange &ar, uint8_t *out, size_t *len);
+bool rpc_get_audios(const AudioBatch &ab, uint8_t *out, size_t *len);
+bool rpc_query_audios(uint64_t job, uint8_t *out, size_t *len);
+
+} // namespace misc
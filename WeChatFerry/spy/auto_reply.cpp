@@ -0,0 +1,428 @@
+﻿#include "auto_reply.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "aho_corasick.h"
+#include "chatroom_manager.h"
+#include "contact_manager.h"
+#include "log.hpp"
+#include "message_sender.h"
+#include "rpc_helper.h"
+
+namespace autoreply
+{
+
+using Clock = std::chrono::steady_clock;
+
+#define MAX_QUEUE_SIZE     1024
+#define MAX_COOLDOWN_KEYS  4096
+#define FORWARD_RETRIES    3
+#define FORWARD_RETRY_WAIT std::chrono::milliseconds(100)
+
+struct Rule {
+    uint32_t id;
+    ReplyRule_Action action;
+    std::unordered_set<uint32_t> types;
+    std::unordered_set<std::string> rooms;
+    std::unordered_set<std::string> senders;
+    bool hasWords = false;
+    std::optional<std::regex> regex;
+    std::string text;
+    std::string path;
+    std::string receiver;
+    bool atSender;
+    bool stop;
+    uint32_t perMinute;
+    Clock::duration cooldown;
+};
+
+// 编译后的规则集，建好后只读；替换时整体换指针，执行线程处理下一条消息时才切到新规则
+struct RuleSet {
+    std::vector<Rule> rules;
+    std::vector<std::vector<uint32_t>> wordRules; // 关键词下标 -> 规则下标
+    std::unique_ptr<util::AhoCorasick> matcher;
+    mutable std::vector<uint8_t> disabled; // 正则执行出错的规则，只在执行线程读写，换规则集后重新启用
+};
+
+// 限流状态与计数按规则 id 保存，重新加载同 id 的规则时保留
+struct RuleState {
+    double tokens = -1; // 令牌桶，-1 为未初始化
+    Clock::time_point refill;
+    std::unordered_map<std::string, Clock::time_point> lastRun; // 会话 -> 上次执行时间
+    uint64_t matched     = 0;
+    uint64_t fired       = 0;
+    uint64_t limited     = 0;
+    uint64_t failed      = 0;
+    uint64_t regexErrors = 0;
+};
+
+struct Job {
+    WxMsg_t msg;
+    Clock::time_point queued;
+};
+
+static std::shared_ptr<const RuleSet> ruleSet;
+
+static std::mutex queueMutex;
+static std::condition_variable queueCv;
+static std::deque<Job> jobs;
+static bool running = false;
+static std::thread worker;
+
+static std::mutex stateMutex;
+static std::unordered_map<uint32_t, RuleState> states;
+static std::atomic<uint64_t> dropped { 0 };
+static std::atomic<uint64_t> latencyMaxUs { 0 };
+static std::atomic<uint64_t> latencyTotalUs { 0 };
+static std::atomic<uint64_t> executed { 0 };
+
+static std::shared_ptr<const RuleSet> current() { return std::atomic_load(&ruleSet); }
+
+static void insert_strings(std::unordered_set<std::string> &set, char **items, pb_size_t count)
+{
+    for (pb_size_t i = 0; i < count; i++) {
+        if (items[i] && items[i][0] != '\0') set.emplace(items[i]);
+    }
+}
+
+static std::string to_string(const char *s) { return s ? s : ""; }
+
+static std::shared_ptr<RuleSet> compile(const ReplyRules &rules)
+{
+    auto set = std::make_shared<RuleSet>();
+    std::vector<std::string> words;
+    std::unordered_map<std::string, uint32_t> wordIndex;
+
+    for (pb_size_t i = 0; i < rules.rules_count; i++) {
+        const ReplyRule &rr = rules.rules[i];
+        uint32_t ruleIdx    = static_cast<uint32_t>(set->rules.size());
+
+        Rule rule {};
+        rule.id        = rr.id;
+        rule.action    = rr.action;
+        rule.text      = to_string(rr.text);
+        rule.path      = to_string(rr.path);
+        rule.receiver  = to_string(rr.receiver);
+        rule.atSender  = rr.at_sender;
+        rule.stop      = rr.stop;
+        rule.perMinute = rr.per_minute;
+        rule.cooldown  = std::chrono::seconds(rr.cooldown);
+        rule.types.insert(rr.types, rr.types + rr.types_count);
+        insert_strings(rule.rooms, rr.rooms, rr.rooms_count);
+        insert_strings(rule.senders, rr.senders, rr.senders_count);
+
+        if ((rule.action == ReplyRule_Action_SEND_TEXT && rule.text.empty())
+            || (rule.action == ReplyRule_Action_SEND_IMAGE && rule.path.empty())) {
+            LOG_ERROR("Reply rule {} has no text or path", rule.id);
+            return nullptr;
+        }
+
+        if (rr.regex && rr.regex[0] != '\0') {
+            try {
+                rule.regex.emplace(rr.regex, std::regex::ECMAScript | std::regex::optimize);
+            } catch (const std::regex_error &e) {
+                LOG_ERROR("Reply rule {} has invalid regex: {}", rule.id, e.what());
+                return nullptr;
+            }
+        }
+
+        for (pb_size_t j = 0; j < rr.keywords_count; j++) {
+            if (rr.keywords[j] == nullptr || rr.keywords[j][0] == '\0') continue;
+            auto [it, inserted] = wordIndex.emplace(rr.keywords[j], static_cast<uint32_t>(words.size()));
+            if (inserted) {
+                words.emplace_back(rr.keywords[j]);
+                set->wordRules.emplace_back();
+            }
+            auto &refs = set->wordRules[it->second];
+            if (refs.empty() || refs.back() != ruleIdx) {
+                refs.push_back(ruleIdx);
+            }
+            rule.hasWords = true;
+        }
+        set->rules.push_back(std::move(rule));
+    }
+
+    set->disabled.assign(set->rules.size(), 0);
+    if (!words.empty()) {
+        set->matcher = std::make_unique<util::AhoCorasick>(words);
+    }
+    return set;
+}
+
+static bool in_scope(const Rule &rule, const WxMsg_t &msg)
+{
+    if (!rule.types.empty() && rule.types.count(msg.type) == 0) return false;
+    if (!rule.rooms.empty() && rule.rooms.count(msg.roomid) == 0) return false;
+    if (!rule.senders.empty() && rule.senders.count(msg.sender) == 0) return false;
+    return true;
+}
+
+// 检查并消耗令牌，同时检查同一会话的冷却时间；调用方持有 stateMutex
+static bool take_quota(const Rule &rule, RuleState &st, const std::string &conversation, Clock::time_point now)
+{
+    if (rule.cooldown.count() > 0) {
+        auto it = st.lastRun.find(conversation);
+        if (it != st.lastRun.end() && now - it->second < rule.cooldown) {
+            return false;
+        }
+    }
+
+    if (rule.perMinute > 0) {
+        double cap = static_cast<double>(rule.perMinute);
+        if (st.tokens < 0) {
+            st.tokens = cap;
+        } else {
+            double elapsed = std::chrono::duration<double>(now - st.refill).count();
+            st.tokens      = std::min(cap, st.tokens + elapsed * cap / 60.0);
+        }
+        st.refill = now;
+        if (st.tokens < 1.0) {
+            return false;
+        }
+        st.tokens -= 1.0;
+    }
+
+    if (rule.cooldown.count() > 0) {
+        if (st.lastRun.size() >= MAX_COOLDOWN_KEYS) {
+            for (auto it = st.lastRun.begin(); it != st.lastRun.end();) {
+                it = (now - it->second >= rule.cooldown) ? st.lastRun.erase(it) : std::next(it);
+            }
+        }
+        st.lastRun[conversation] = now;
+    }
+    return true;
+}
+
+static bool run_action(const Rule &rule, const WxMsg_t &msg)
+{
+    auto &sender         = message::Sender::get_instance();
+    std::string receiver = rule.receiver.empty() ? msg.roomid : rule.receiver;
+
+    switch (rule.action) {
+        case ReplyRule_Action_SEND_TEXT: {
+            if (rule.atSender && msg.is_group && receiver == msg.roomid) {
+                std::string name;
+                if (!chatroom::find_member_alias(msg.roomid, msg.sender, name) || name.empty()) {
+                    contact::find_contact_name(msg.sender, name);
+                }
+                // @ 后面的名字以 U+2005 结尾，微信才会显示为提醒
+                sender.send_text(receiver, "@" + (name.empty() ? msg.sender : name) + "\xE2\x80\x85" + rule.text,
+                                 msg.sender);
+            } else {
+                sender.send_text(receiver, rule.text);
+            }
+            return true;
+        }
+        case ReplyRule_Action_SEND_IMAGE:
+            sender.send_image(receiver, rule.path);
+            return true;
+        case ReplyRule_Action_FORWARD: {
+            // Hook 在微信写库之前触发，消息可能还查不到 localId，稍等重试
+            int status = -1;
+            for (int i = 0; i < FORWARD_RETRIES && status == -1; i++) {
+                if (i > 0) std::this_thread::sleep_for(FORWARD_RETRY_WAIT);
+                status = sender.forward(msg.id, receiver);
+            }
+            return status == 1;
+        }
+        case ReplyRule_Action_PAT:
+            return msg.is_group && sender.send_pat(msg.roomid, msg.sender) == 1;
+        default:
+            return false;
+    }
+}
+
+static void execute(const RuleSet &set, const Job &job)
+{
+    const WxMsg_t &msg = job.msg;
+
+    std::vector<uint8_t> wordHit(set.rules.size(), 0);
+    if (set.matcher) {
+        set.matcher->match(msg.content, [&](uint32_t word) {
+            for (uint32_t r : set.wordRules[word]) wordHit[r] = 1;
+        });
+    }
+
+    for (size_t r = 0; r < set.rules.size(); r++) {
+        const Rule &rule = set.rules[r];
+        if (!in_scope(rule, msg)) continue;
+        if (rule.hasWords && !wordHit[r]) continue;
+        if (set.disabled[r]) continue;
+        if (rule.regex) {
+            bool hit = false;
+            try {
+                hit = std::regex_search(msg.content, *rule.regex);
+            } catch (const std::exception &e) {
+                // 回溯过深（error_complexity、error_stack）等，同一规则对别的消息多半也会出错，停用这条规则
+                LOG_ERROR("Reply rule {} regex failed, disabled: {}", rule.id, e.what());
+                set.disabled[r] = 1;
+                std::lock_guard<std::mutex> lock(stateMutex);
+                states[rule.id].regexErrors++;
+                continue;
+            }
+            if (!hit) continue;
+        }
+
+        bool allowed;
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            RuleState &st = states[rule.id];
+            st.matched++;
+            allowed = take_quota(rule, st, msg.roomid, Clock::now());
+            if (!allowed) st.limited++;
+        }
+
+        if (allowed) {
+            bool ok = false;
+            try {
+                ok = run_action(rule, msg);
+            } catch (const std::exception &e) {
+                LOG_ERROR("Reply rule {} failed: {}", rule.id, e.what());
+            }
+
+            auto us = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - job.queued).count());
+            uint64_t prev = latencyMaxUs.load();
+            while (us > prev && !latencyMaxUs.compare_exchange_weak(prev, us)) { }
+            latencyTotalUs += us;
+            executed++;
+
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (ok) {
+                states[rule.id].fired++;
+            } else {
+                states[rule.id].failed++;
+            }
+        }
+
+        if (rule.stop) break;
+    }
+}
+
+static void work()
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (true) {
+        queueCv.wait(lock, [] { return !running || !jobs.empty(); });
+        if (!running) {
+            break;
+        }
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+
+        if (auto set = current()) {
+            execute(*set, job);
+        }
+        lock.lock();
+    }
+}
+
+int set_rules(const ReplyRules &rules)
+{
+    if (rules.rules_count == 0) {
+        stop();
+        LOG_INFO("Reply rules cleared");
+        return 0;
+    }
+
+    auto set = compile(rules);
+    if (!set) {
+        return -1;
+    }
+
+    LOG_INFO("Reply rules loaded: {} rules", set->rules.size());
+    std::atomic_store(&ruleSet, std::shared_ptr<const RuleSet>(std::move(set)));
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (!running) {
+        running = true;
+        worker  = std::thread(work);
+    }
+    return static_cast<int>(rules.rules_count);
+}
+
+bool is_active() { return current() != nullptr; }
+
+void post(const WxMsg_t &msg)
+{
+    if (msg.is_self || msg.event.has_value() || !is_active()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running) {
+            return;
+        }
+        if (jobs.size() >= MAX_QUEUE_SIZE) {
+            dropped++;
+            return;
+        }
+        jobs.push_back({ msg, Clock::now() });
+    }
+    queueCv.notify_one();
+}
+
+void stop()
+{
+    std::atomic_store(&ruleSet, std::shared_ptr<const RuleSet>());
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+        jobs.clear();
+    }
+    queueCv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void collect_stats(Stats_t &stats)
+{
+    auto set = current();
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stats["reply.queued"] = jobs.size();
+    }
+    stats["reply.rules"]            = set ? set->rules.size() : 0;
+    stats["reply.dropped"]          = dropped.load();
+    stats["reply.executed"]         = executed.load();
+    stats["reply.latency_max_us"]   = latencyMaxUs.load();
+    stats["reply.latency_total_us"] = latencyTotalUs.load();
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    for (const auto &[id, st] : states) {
+        std::string prefix             = "reply.rule." + std::to_string(id) + ".";
+        stats[prefix + "matched"]      = st.matched;
+        stats[prefix + "fired"]        = st.fired;
+        stats[prefix + "limited"]      = st.limited;
+        stats[prefix + "failed"]       = st.failed;
+        stats[prefix + "regex_errors"] = st.regexErrors;
+    }
+}
+
+bool rpc_set_rules(const ReplyRules &rules, uint8_t *out, size_t *len)
+{
+    return fill_response<Functions_FUNC_SET_REPLY_RULES>(out, len,
+                                                          [&](Response &rsp) { rsp.msg.status = set_rules(rules); });
+}
+
+} // namespace autoreply
@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "wcf.pb.h"
+
+#include "pb_types.h"
+
+namespace autoreply
+{
+
+// 编译并整体替换自动回复规则，队列中的消息不受影响，由新规则继续处理
+// 消息来自接收 Hook，需先开启消息接收（FUNC_ENABLE_RECV_TXT）
+// 返回规则数，规则为空时停止执行线程，出错（如正则无效）返回 -1
+int set_rules(const ReplyRules &rules);
+
+// 是否已加载规则
+bool is_active();
+
+// Hook 线程调用，只入队不执行；自己发送的消息不处理，避免回复自己
+void post(const WxMsg_t &msg);
+
+// 停止执行线程并清空规则
+void stop();
+
+// 每条规则的命中、执行、限流、失败计数
+void collect_stats(Stats_t &stats);
+
+// RPC 方法
+bool rpc_set_rules(const ReplyRules &rules, uint8_t *out, size_t *len);
+
+} // namespace autoreply
@@ -1,7 +1,22 @@
 ﻿#pragma execution_character_set("utf-8")
 
 #include "chatroom_manager.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "contact_manager.h"
+#include "database_executor.h"
 #include "log.hpp"
+#include "message_handler.h"
 #include "offsets.h"
 #include "pb_util.h"
 #include "rpc_helper.h"
@@ -69,6 +84,369 @@ int invite_chatroom_member(const string &roomid, const string &wxids)
     return static_cast<int>(invite_members(ws_roomid.c_str(), p_members, wx_roomid, reinterpret_cast<QWORD>(tmp)));
 }
 
+// 群成员缓存：解码后的 RoomData，昵称在查询时再从联系人缓存关联
+struct CachedRoom {
+    bool loaded         = false;
+    uint64_t generation = 0; // 写入这份数据的那次读库的序号
+    RoomMembers_t room;
+    std::unordered_map<string, size_t> index; // wxid -> room.members 下标
+    std::chrono::steady_clock::time_point expire;
+    std::chrono::steady_clock::time_point settle; // 收到成员变动消息后，数据库可能还没更新
+};
+
+#define ROOM_CACHE_TTL   std::chrono::seconds(60)
+#define ROOM_SETTLE_TTL  std::chrono::seconds(1)
+#define ROOM_SETTLE_TIME std::chrono::seconds(3)
+#define ROOM_SWEEP_TIME  std::chrono::minutes(10) // 跟踪群成员变动时，全量核对一次的间隔
+
+static std::mutex roomMutex;
+static std::unordered_map<string, CachedRoom> roomCache;
+static uint64_t loadGeneration = 0; // 每次读库前加一；RPC 线程和跟踪线程可能同时读同一个群，旧的结果不能覆盖新的
+static uint64_t staleLoads     = 0;
+static uint64_t evictedRooms   = 0;
+
+// 群成员变动跟踪，以下状态均由 roomMutex 保护
+static std::atomic<bool> watching { false };
+static std::thread watchThread;
+static std::condition_variable watchCv;
+static std::unordered_map<string, std::chrono::steady_clock::time_point> pendingRooms; // 群 -> 计划核对时间
+static std::chrono::steady_clock::time_point nextSweep;
+
+static bool decode_room_data(const vector<uint8_t> &blob, RoomMembers_t &room)
+{
+    RoomData rd         = RoomData_init_default;
+    pb_istream_t stream = pb_istream_from_buffer(blob.data(), blob.size());
+    if (!pb_decode(&stream, RoomData_fields, &rd)) {
+        LOG_ERROR("RoomData 解码失败: {}", PB_GET_ERROR(&stream));
+        pb_release(RoomData_fields, &rd);
+        return false;
+    }
+
+    room.members.reserve(rd.members_count);
+    for (pb_size_t i = 0; i < rd.members_count; i++) {
+        const RoomData_RoomMember &m = rd.members[i];
+        room.members.push_back({ m.wxid ? m.wxid : "", "", m.name ? m.name : "" });
+    }
+    for (pb_size_t i = 0; i < rd.admins_count; i++) {
+        room.admins.emplace_back(rd.admins[i] ? rd.admins[i] : "");
+    }
+
+    pb_release(RoomData_fields, &rd);
+    return true;
+}
+
+static string quote_sql(const string &s)
+{
+    string quoted = "'";
+    for (char c : s) {
+        quoted += (c == '\'') ? "''" : string(1, c);
+    }
+    return quoted + "'";
+}
+
+// 一次查询读取多个群的 RoomData
+static RoomMembersList_t load_rooms(const vector<string> &roomids)
+{
+    string sql = "SELECT ChatRoomName, RoomData FROM ChatRoom WHERE ChatRoomName IN (";
+    for (size_t i = 0; i < roomids.size(); i++) {
+        sql += (i ? "," : "") + quote_sql(roomids[i]);
+    }
+    sql += ");";
+
+    RoomMembersList_t rooms;
+    for (const DbRow_t &row : db::exec_db_query("MicroMsg.db", sql)) {
+        if (row.size() < 2) {
+            continue;
+        }
+        RoomMembers_t room;
+        room.roomid.assign(row[0].content.begin(), row[0].content.end());
+        if (decode_room_data(row[1].content, room)) {
+            rooms.push_back(std::move(room));
+        }
+    }
+    return rooms;
+}
+
+// 比较新旧成员列表，生成变动事件
+static void diff_room(const RoomMembers_t &before, const RoomMembers_t &after, vector<WxMsg_t> &events)
+{
+    std::unordered_map<string, const string *> old;
+    for (const auto &m : before.members) {
+        old.emplace(m.wxid, &m.alias);
+    }
+
+    vector<string> joined, renamed, left;
+    for (const auto &m : after.members) {
+        auto it = old.find(m.wxid);
+        if (it == old.end()) {
+            joined.push_back(m.wxid);
+            continue;
+        }
+        if (*it->second != m.alias) {
+            renamed.push_back(m.wxid);
+        }
+        old.erase(it);
+    }
+    for (const auto &m : before.members) {
+        if (old.count(m.wxid)) {
+            left.push_back(m.wxid);
+        }
+    }
+
+    vector<string> admins;
+    std::unordered_set<string> oldAdmins(before.admins.begin(), before.admins.end());
+    std::unordered_set<string> newAdmins(after.admins.begin(), after.admins.end());
+    for (const auto &a : after.admins) {
+        if (!oldAdmins.count(a)) admins.push_back(a);
+    }
+    for (const auto &a : before.admins) {
+        if (!newAdmins.count(a)) admins.push_back(a);
+    }
+
+    auto emit = [&](RoomEvent_Type type, vector<string> &wxids) {
+        if (wxids.empty()) {
+            return;
+        }
+        WxMsg_t msg  = {};
+        msg.type     = ROOM_EVENT_MSG_TYPE;
+        msg.is_group = true;
+        msg.ts       = static_cast<uint32_t>(std::time(nullptr));
+        msg.roomid   = after.roomid;
+        msg.event    = RoomEvent_t { type, std::move(wxids), static_cast<uint32_t>(after.members.size()) };
+        events.push_back(std::move(msg));
+    };
+    emit(RoomEvent_Type_JOIN, joined);
+    emit(RoomEvent_Type_LEAVE, left);
+    emit(RoomEvent_Type_RENAME, renamed);
+    emit(RoomEvent_Type_ADMIN, admins);
+}
+
+// 读库并更新缓存，跟踪中的群有变动时推送事件
+static void reload_rooms(const vector<string> &roomids)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(roomMutex);
+        generation = ++loadGeneration;
+    }
+
+    // 查库时不持锁，避免阻塞消息回调里的失效通知
+    RoomMembersList_t loaded = load_rooms(roomids);
+
+    vector<WxMsg_t> events;
+    {
+        std::lock_guard<std::mutex> lock(roomMutex);
+        auto now = std::chrono::steady_clock::now();
+        std::unordered_set<string> found;
+        for (auto &room : loaded) {
+            found.insert(room.roomid);
+            CachedRoom &entry = roomCache[room.roomid];
+            if (entry.generation > generation) {
+                staleLoads++; // 之后开始的读库已经写入了更新的数据
+                continue;
+            }
+            entry.generation = generation;
+            if (watching && entry.loaded) {
+                diff_room(entry.room, room, events);
+            }
+            entry.loaded = true;
+            entry.expire = now + (now < entry.settle ? ROOM_SETTLE_TTL : ROOM_CACHE_TTL);
+            entry.room   = std::move(room);
+            entry.index.clear();
+            for (size_t i = 0; i < entry.room.members.size(); i++) {
+                entry.index.emplace(entry.room.members[i].wxid, i);
+            }
+        }
+
+        // 查不到的群（已解散、已退出）不再留在缓存里，也不再参与全量核对
+        for (const auto &roomid : roomids) {
+            auto it = roomCache.find(roomid);
+            if (!found.count(roomid) && it != roomCache.end() && it->second.generation <= generation) {
+                roomCache.erase(it);
+                evictedRooms++;
+            }
+        }
+    }
+
+    auto &handler = message::Handler::getInstance();
+    for (auto &msg : events) {
+        handler.pushMessage(std::move(msg));
+    }
+}
+
+RoomMembersList_t get_room_members(const vector<string> &roomids)
+{
+    vector<string> stale;
+    {
+        std::lock_guard<std::mutex> lock(roomMutex);
+        auto now = std::chrono::steady_clock::now();
+        for (const auto &roomid : roomids) {
+            auto it = roomCache.find(roomid);
+            if (it == roomCache.end() || !it->second.loaded || now >= it->second.expire) {
+                stale.push_back(roomid);
+            }
+        }
+    }
+
+    if (!stale.empty()) {
+        reload_rooms(stale);
+    }
+
+    RoomMembersList_t rooms;
+    {
+        std::lock_guard<std::mutex> lock(roomMutex);
+        for (const auto &roomid : roomids) {
+            auto it = roomCache.find(roomid);
+            if (it != roomCache.end() && it->second.loaded) {
+                rooms.push_back(it->second.room);
+            }
+        }
+    }
+
+    for (auto &room : rooms) {
+        vector<string> wxids;
+        wxids.reserve(room.members.size());
+        for (const auto &m : room.members) {
+            wxids.push_back(m.wxid);
+        }
+        vector<string> names = contact::get_contact_names(wxids);
+        for (size_t i = 0; i < room.members.size(); i++) {
+            room.members[i].name = std::move(names[i]);
+        }
+    }
+    return rooms;
+}
+
+bool find_member_alias(const string &roomid, const string &wxid, string &alias)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(roomMutex);
+    auto it     = roomCache.find(roomid);
+    bool usable = (it != roomCache.end() && it->second.loaded);
+
+    // 缺失或过期时交给后台线程读库，这里不等，先用旧数据
+    if (watching && (!usable || now >= it->second.expire) && !pendingRooms.count(roomid)) {
+        pendingRooms[roomid] = now;
+        watchCv.notify_one();
+    }
+    if (!usable) {
+        return false;
+    }
+
+    auto m = it->second.index.find(wxid);
+    if (m == it->second.index.end()) {
+        return false;
+    }
+    alias = it->second.room.members[m->second].alias;
+    return true;
+}
+
+void collect_stats(Stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(roomMutex);
+    stats["room.cached"]      = roomCache.size();
+    stats["room.pending"]     = pendingRooms.size();
+    stats["room.stale_loads"] = staleLoads;
+    stats["room.evicted"]     = evictedRooms;
+}
+
+void on_room_message(const string &roomid, bool system)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(roomMutex);
+    auto it = roomCache.find(roomid);
+    if (system && it != roomCache.end()) {
+        it->second.expire = now;
+        it->second.settle = now + ROOM_SETTLE_TIME;
+    }
+
+    if (!watching) {
+        return;
+    }
+
+    if (system) {
+        pendingRooms[roomid] = now + ROOM_SETTLE_TIME; // 等数据库更新后再核对
+        watchCv.notify_one();
+    } else if (it == roomCache.end() && !pendingRooms.count(roomid)) {
+        pendingRooms[roomid] = now; // 第一次见到的群，先建立快照
+        watchCv.notify_one();
+    }
+}
+
+static void watch_rooms()
+{
+    std::unique_lock<std::mutex> lock(roomMutex);
+    while (watching) {
+        auto now  = std::chrono::steady_clock::now();
+        auto wake = nextSweep;
+        vector<string> due;
+        for (auto it = pendingRooms.begin(); it != pendingRooms.end();) {
+            if (it->second <= now) {
+                due.push_back(it->first);
+                it = pendingRooms.erase(it);
+            } else {
+                wake = std::min(wake, it->second);
+                ++it;
+            }
+        }
+
+        if (now >= nextSweep) {
+            for (const auto &[roomid, entry] : roomCache) {
+                if (entry.loaded && std::find(due.begin(), due.end(), roomid) == due.end()) {
+                    due.push_back(roomid);
+                }
+            }
+            nextSweep = now + ROOM_SWEEP_TIME;
+        }
+
+        if (due.empty()) {
+            watchCv.wait_until(lock, wake);
+            continue;
+        }
+
+        lock.unlock();
+        reload_rooms(due);
+        lock.lock();
+    }
+}
+
+void start_room_watch()
+{
+    std::lock_guard<std::mutex> lock(roomMutex);
+    if (watching) {
+        return;
+    }
+    watching    = true;
+    nextSweep   = std::chrono::steady_clock::now() + ROOM_SWEEP_TIME;
+    watchThread = std::thread(watch_rooms);
+}
+
+void stop_room_watch()
+{
+    {
+        std::lock_guard<std::mutex> lock(roomMutex);
+        if (!watching) {
+            return;
+        }
+        watching = false;
+        pendingRooms.clear();
+    }
+    watchCv.notify_all();
+    if (watchThread.joinable()) {
+        watchThread.join();
+    }
+}
+
+template <Functions FuncType>
+static bool rpc_room_members_common(const vector<string> &roomids, uint8_t *out, size_t *len)
+{
+    RoomMembersList_t rooms = get_room_members(roomids);
+    return fill_response<FuncType>(out, len, [&](Response &rsp) {
+        rsp.msg.rooms.rooms.funcs.encode = encode_rooms;
+        rsp.msg.rooms.rooms.arg          = &rooms;
+    });
+}
+
 bool rpc_add_chatroom_member(const MemberMgmt &m, uint8_t *out, size_t *len)
 {
     return rpc_chatroom_common<Functions_FUNC_ADD_ROOM_MEMBERS>(m, out, len, add_chatroom_member);
@@ -84,4 +462,19 @@ bool rpc_invite_chatroom_member(const MemberMgmt &m, uint8_t *out, size_t *len)
     return rpc_chatroom_common<Functions_FUNC_INV_ROOM_MEMBERS>(m, out, len, invite_chatroom_member);
 }
 
+bool rpc_get_room_members(const string &roomid, uint8_t *out, size_t *len)
+{
+    return rpc_room_members_common<Functions_FUNC_GET_ROOM_MEMBERS>({ roomid }, out, len);
+}
+
+bool rpc_batch_room_members(const string &roomids, uint8_t *out, size_t *len)
+{
+    vector<string> ids;
+    std::stringstream ss(roomids);
+    for (string id; std::getline(ss, id, ',');) {
+        ids.push_back(id);
+    }
+    return rpc_room_members_common<Functions_FUNC_BATCH_ROOM_MEMBERS>(ids, out, len);
+}
+
 } // namespace chatroom
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "wcf.pb.h"
 
+#include "pb_types.h"
+
 namespace chatroom
 {
 
@@ -16,9 +19,30 @@ int del_chatroom_member(const std::string &roomid, const std::string &wxids);
 // 邀请成员加入群聊
 int invite_chatroom_member(const std::string &roomid, const std::string &wxids);
 
+// 获取群成员，优先读缓存，缺失或过期的群一次查库解码 RoomData
+RoomMembersList_t get_room_members(const std::vector<std::string> &roomids);
+
+// 从缓存中查群昵称，不读库；缺失或过期时安排后台刷新，查不到返回 false
+bool find_member_alias(const std::string &roomid, const std::string &wxid, std::string &alias);
+
+// 缓存统计
+void collect_stats(Stats_t &stats);
+
+// 群成员变动事件的消息类型
+constexpr uint32_t ROOM_EVENT_MSG_TYPE = 0x10000;
+
+// 收到群消息时调用，system 为系统消息（可能是成员变动）时让该群缓存失效
+void on_room_message(const std::string &roomid, bool system);
+
+// 开始/停止跟踪群成员变动，变动以 ROOM_EVENT_MSG_TYPE 消息推送
+void start_room_watch();
+void stop_room_watch();
+
 // RPC 方法
 bool rpc_add_chatroom_member(const MemberMgmt &m, uint8_t *out, size_t *len);
 bool rpc_delete_chatroom_member(const MemberMgmt &m, uint8_t *out, size_t *len);
 bool rpc_invite_chatroom_member(const MemberMgmt &m, uint8_t *out, size_t *len);
+bool rpc_get_room_members(const std::string &roomid, uint8_t *out, size_t *len);
+bool rpc_batch_room_members(const std::string &roomids, uint8_t *out, size_t *len);
 
 } // namespace chatroom
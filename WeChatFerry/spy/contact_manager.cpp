@@ -2,10 +2,18 @@
 
 #include "contact_manager.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
 #include "log.hpp"
 #include "offsets.h"
 #include "pb_util.h"
 #include "rpc_helper.h"
+#include "scanner.h"
 #include "spy.h"
 #include "util.h"
 
@@ -23,26 +31,39 @@ static const uint8_t FEAT_COUNTRY[FEAT_LEN]  = { 0xA4, 0xD9, 0x02, 0x4A, 0x18 };
 static const uint8_t FEAT_PROVINCE[FEAT_LEN] = { 0xE2, 0xEA, 0xA8, 0xD1, 0x18 };
 static const uint8_t FEAT_CITY[FEAT_LEN]     = { 0x1D, 0x02, 0x5B, 0xBF, 0x18 };
 
-static QWORD find_mem(QWORD start, QWORD end, const void *target, size_t len)
+enum { FEAT_IDX_COUNTRY, FEAT_IDX_PROVINCE, FEAT_IDX_CITY, FEAT_NUM };
+
+// 三个地区特征在一次扫描中同时查找
+static const util::MultiScanner &region_scanner()
 {
-    uint8_t *p = reinterpret_cast<uint8_t *>(start);
-    while (reinterpret_cast<QWORD>(p) < end) {
-        if (memcmp(p, target, len) == 0) {
-            return reinterpret_cast<QWORD>(p);
-        }
-        p++;
-    }
-    return 0;
+    static const util::MultiScanner scanner({
+        vector<uint8_t>(FEAT_COUNTRY, FEAT_COUNTRY + FEAT_LEN),
+        vector<uint8_t>(FEAT_PROVINCE, FEAT_PROVINCE + FEAT_LEN),
+        vector<uint8_t>(FEAT_CITY, FEAT_CITY + FEAT_LEN),
+    });
+    return scanner;
 }
 
-static string get_cnt_string(QWORD start, QWORD end, const uint8_t *feat, size_t len)
+static bool want_region(FieldMask_t mask)
 {
-    QWORD pfeat = find_mem(start, end, feat, len);
-    if (pfeat == 0) {
+    return has_field(mask, RpcContact_country_tag) || has_field(mask, RpcContact_province_tag)
+        || has_field(mask, RpcContact_city_tag);
+}
+
+static util::MultiScanner::Blob contact_blob(QWORD p)
+{
+    return { reinterpret_cast<const uint8_t *>(util::get_qword(p + OsCon::BIN)),
+             util::get_dword(p + OsCon::BIN_LEN) };
+}
+
+static string get_cnt_string(const util::MultiScanner::Blob &blob, size_t offset)
+{
+    if (offset == util::MultiScanner::npos) {
         return "";
     }
 
-    DWORD lfeat = util::get_dword(pfeat + len);
+    QWORD pfeat = reinterpret_cast<QWORD>(blob.data) + offset;
+    DWORD lfeat = util::get_dword(pfeat + FEAT_LEN);
     if (lfeat <= 2) {
         return "";
     }
@@ -50,42 +71,297 @@ static string get_cnt_string(QWORD start, QWORD end, const uint8_t *feat, size_t
     return util::w2s(util::get_p_wstring(pfeat + FEAT_LEN + 4, lfeat));
 }
 
-vector<RpcContact_t> get_contacts()
+// 遍历微信内存中的联系人列表，返回 false 表示获取失败
+template <typename F> static bool walk_contacts(F &&visit)
 {
-    vector<RpcContact_t> contacts;
     auto func_get_contact_mgr  = Spy::getFunction<get_contact_mgr_t>(OsCon::MGR);
     auto func_get_contact_list = Spy::getFunction<get_contact_list_t>(OsCon::LIST);
 
     QWORD mgr     = func_get_contact_mgr();
     QWORD addr[3] = { 0 };
     if (func_get_contact_list(mgr, reinterpret_cast<QWORD>(addr)) != 1) {
+        return false;
+    }
+
+    for (QWORD p = addr[0]; p < addr[2]; p += OsCon::STEP) {
+        visit(p);
+    }
+    return true;
+}
+
+// hits 为地区特征的扫描结果，传空则按需自行扫描
+static RpcContact_t read_contact(QWORD p, FieldMask_t mask, const size_t *hits = nullptr)
+{
+    RpcContact_t cnt;
+    auto blob = contact_blob(p);
+    auto want = [mask](uint32_t tag) { return has_field(mask, tag); };
+
+    cnt.wxid   = want(RpcContact_wxid_tag) ? util::get_str_by_wstr_addr(p + OsCon::WXID) : "";
+    cnt.code   = want(RpcContact_code_tag) ? util::get_str_by_wstr_addr(p + OsCon::CODE) : "";
+    cnt.remark = want(RpcContact_remark_tag) ? util::get_str_by_wstr_addr(p + OsCon::REMARK) : "";
+    cnt.name   = want(RpcContact_name_tag) ? util::get_str_by_wstr_addr(p + OsCon::NAME) : "";
+
+    // 地区信息需要扫描二进制数据，没有请求就不算
+    vector<size_t> own;
+    if (hits == nullptr && want_region(mask)) {
+        region_scanner().scan(blob.data, blob.len, own);
+        hits = own.data();
+    }
+    if (hits != nullptr) {
+        cnt.country  = want(RpcContact_country_tag) ? get_cnt_string(blob, hits[FEAT_IDX_COUNTRY]) : "";
+        cnt.province = want(RpcContact_province_tag) ? get_cnt_string(blob, hits[FEAT_IDX_PROVINCE]) : "";
+        cnt.city     = want(RpcContact_city_tag) ? get_cnt_string(blob, hits[FEAT_IDX_CITY]) : "";
+    }
+
+    cnt.gender = (blob.data == nullptr) ? 0 : static_cast<DWORD>(blob.data[OsCon::GENDER]);
+    return cnt;
+}
+
+vector<RpcContact_t> get_contacts(FieldMask_t mask)
+{
+    vector<RpcContact_t> contacts;
+    vector<QWORD> addrs;
+    if (!walk_contacts([&](QWORD p) { addrs.push_back(p); })) {
         LOG_ERROR("get_contacts failed");
         return contacts;
     }
 
-    QWORD pstart = addr[0];
-    QWORD pend   = addr[2];
-    while (pstart < pend) {
-        RpcContact_t cnt;
-        QWORD pbin   = util::get_qword(pstart + OsCon::BIN);
-        QWORD lenbin = util::get_dword(pstart + OsCon::BIN_LEN);
+    // 所有联系人的二进制数据一次批量扫描
+    vector<size_t> hits;
+    if (want_region(mask)) {
+        vector<util::MultiScanner::Blob> blobs;
+        blobs.reserve(addrs.size());
+        for (QWORD p : addrs) {
+            blobs.push_back(contact_blob(p));
+        }
+        region_scanner().scan_batch(blobs, hits);
+    }
+
+    contacts.reserve(addrs.size());
+    for (size_t i = 0; i < addrs.size(); i++) {
+        contacts.push_back(read_contact(addrs[i], mask, hits.empty() ? nullptr : &hits[i * FEAT_NUM]));
+    }
+    return contacts;
+}
+
+// 联系人快照缓存：按原始内存算哈希，只有新增或变更的联系人才重新转码、扫描
+struct CachedContact {
+    RpcContact_t contact;
+    uint64_t version; // 最后一次变更时的版本号
+};
+
+// 遍历用的状态，只在 refreshMutex 下读写
+struct WalkedContact {
+    uint64_t hash;
+    uint64_t seen; // 最后一次出现在列表中的刷新轮次
+};
+
+#define CACHE_REFRESH_INTERVAL      std::chrono::seconds(3)
+#define CACHE_MISS_REFRESH_INTERVAL std::chrono::milliseconds(500) // 按 wxid 查不到时，允许提前刷新
+#define CACHE_MAX_REMOVED           10000
+
+// 遍历和哈希在 refreshMutex 下进行，cacheMutex 只在合并结果和查询时短暂持有
+static std::mutex refreshMutex;
+static unordered_map<wstring, WalkedContact> walked;
+static uint64_t refreshRound = 0;
+static std::chrono::steady_clock::time_point lastRefresh;
+
+static std::mutex cacheMutex;
+static unordered_map<wstring, CachedContact> contactCache;
+static unordered_map<string, uint64_t> removedContacts; // wxid -> 删除时的版本号
+static uint64_t cacheVersion = 0;
+static uint64_t minVersion   = 0; // 小于该版本的请求无法给出增量，只能返回全量
+
+// 推送线程查昵称时不遍历，缓存由后台线程刷新
+static std::mutex refresherMutex;
+static std::condition_variable refresherCv;
+static std::thread refresher;
+static bool refreshWanted    = false;
+static bool refresherRunning = false;
+static bool refresherStopped = false;
+
+static inline void fnv1a(uint64_t &h, const void *data, size_t len)
+{
+    auto p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+}
+
+static inline void hash_wx_string(uint64_t &h, QWORD addr)
+{
+    QWORD ptr = util::get_qword(addr);
+    DWORD len = util::get_dword(addr + 8);
+    if (ptr && len) {
+        fnv1a(h, reinterpret_cast<const void *>(ptr), len * sizeof(wchar_t));
+    }
+    fnv1a(h, &len, sizeof(len)); // 分隔相邻字段
+}
 
-        cnt.wxid   = util::get_str_by_wstr_addr(pstart + OsCon::WXID);
-        cnt.code   = util::get_str_by_wstr_addr(pstart + OsCon::CODE);
-        cnt.remark = util::get_str_by_wstr_addr(pstart + OsCon::REMARK);
-        cnt.name   = util::get_str_by_wstr_addr(pstart + OsCon::NAME);
+static uint64_t hash_contact(QWORD p)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    hash_wx_string(h, p + OsCon::CODE);
+    hash_wx_string(h, p + OsCon::REMARK);
+    hash_wx_string(h, p + OsCon::NAME);
 
-        cnt.country  = get_cnt_string(pbin, pbin + lenbin, FEAT_COUNTRY, FEAT_LEN);
-        cnt.province = get_cnt_string(pbin, pbin + lenbin, FEAT_PROVINCE, FEAT_LEN);
-        cnt.city     = get_cnt_string(pbin, pbin + lenbin, FEAT_CITY, FEAT_LEN);
+    QWORD pbin   = util::get_qword(p + OsCon::BIN);
+    DWORD lenbin = util::get_dword(p + OsCon::BIN_LEN);
+    if (pbin && lenbin) {
+        fnv1a(h, reinterpret_cast<const void *>(pbin), lenbin);
+    }
+    return h;
+}
 
-        cnt.gender = (pbin == 0) ? 0 : static_cast<DWORD>(*(uint8_t *)(pbin + OsCon::GENDER));
+// 距上次刷新超过 interval 才重新遍历，返回是否遍历过；调用方不能持有 cacheMutex
+static bool refresh_cache(std::chrono::steady_clock::duration interval)
+{
+    std::lock_guard<std::mutex> walkLock(refreshMutex);
+    auto now = std::chrono::steady_clock::now();
+    if (refreshRound != 0 && now - lastRefresh < interval) {
+        return false;
+    }
 
-        contacts.push_back(cnt);
-        pstart += OsCon::STEP;
+    struct Changed {
+        wstring wxid;
+        RpcContact_t contact;
+    };
+    vector<Changed> changed;
+    vector<wstring> removed;
+    uint64_t round = ++refreshRound;
+    bool ok        = walk_contacts([&](QWORD p) {
+        wstring wxid = util::get_pp_len_wstring(p + OsCon::WXID);
+        uint64_t h   = hash_contact(p);
+        auto it      = walked.find(wxid);
+        if (it == walked.end() || it->second.hash != h) {
+            changed.push_back({ wxid, read_contact(p, 0) });
+            walked[std::move(wxid)] = { h, round };
+        } else {
+            it->second.seen = round;
+        }
+    });
+    lastRefresh = now;
+    if (ok) {
+        for (auto it = walked.begin(); it != walked.end();) {
+            if (it->second.seen != round) {
+                removed.push_back(it->first);
+                it = walked.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    } else {
+        LOG_ERROR("refresh contact cache failed");
     }
 
-    return contacts;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (cacheVersion == 0) {
+        // 以时间戳作为初始版本号，注入重启后旧版本号不会与新版本号混淆
+        cacheVersion = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                 std::chrono::system_clock::now().time_since_epoch())
+                                                 .count());
+        minVersion = cacheVersion;
+    }
+
+    uint64_t next = cacheVersion + 1;
+    for (auto &c : changed) {
+        removedContacts.erase(c.contact.wxid); // 删除后又加回来的，不能再出现在 removed 里
+        contactCache[std::move(c.wxid)] = { std::move(c.contact), next };
+    }
+    for (const auto &wxid : removed) {
+        auto it = contactCache.find(wxid);
+        if (it != contactCache.end()) {
+            removedContacts[it->second.contact.wxid] = next;
+            contactCache.erase(it);
+        }
+    }
+
+    if (removedContacts.size() > CACHE_MAX_REMOVED) {
+        // 删除记录太多，丢弃后更早的版本只能全量同步
+        removedContacts.clear();
+        minVersion = next;
+    }
+
+    if (!changed.empty() || !removed.empty()) {
+        cacheVersion = next;
+    }
+    return ok;
+}
+
+static void refresh_in_background()
+{
+    std::unique_lock<std::mutex> lock(refresherMutex);
+    while (true) {
+        refresherCv.wait(lock, [] { return refresherStopped || refreshWanted; });
+        if (refresherStopped) {
+            break;
+        }
+        refreshWanted = false;
+        lock.unlock();
+        refresh_cache(CACHE_REFRESH_INTERVAL);
+        lock.lock();
+    }
+}
+
+// 请求后台刷新，缓存未过期时后台线程什么也不做
+static void request_refresh()
+{
+    {
+        std::lock_guard<std::mutex> lock(refresherMutex);
+        if (refresherStopped) {
+            return;
+        }
+        refreshWanted = true;
+        if (!refresherRunning) {
+            refresherRunning = true;
+            refresher        = std::thread(refresh_in_background);
+        }
+    }
+    refresherCv.notify_one();
+}
+
+static bool lookup(const wstring &wxid, RpcContact_t &contact)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = contactCache.find(wxid);
+    if (it == contactCache.end()) {
+        return false;
+    }
+    contact = it->second.contact;
+    return true;
+}
+
+// 调用方不能持有 cacheMutex
+static bool find_cached(const wstring &wxid, RpcContact_t &contact)
+{
+    refresh_cache(CACHE_REFRESH_INTERVAL);
+    if (lookup(wxid, contact)) {
+        return true;
+    }
+    return refresh_cache(CACHE_MISS_REFRESH_INTERVAL) && lookup(wxid, contact); // 可能是刚加的好友
+}
+
+ContactsDelta_t get_contacts_since(uint64_t version)
+{
+    refresh_cache(CACHE_REFRESH_INTERVAL);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    ContactsDelta_t delta;
+    delta.version = cacheVersion;
+    delta.full    = (version == 0 || version < minVersion || version > cacheVersion);
+    for (const auto &[_, c] : contactCache) {
+        if (delta.full || c.version > version) {
+            delta.contacts.push_back(c.contact);
+        }
+    }
+    if (!delta.full) {
+        for (const auto &[wxid, v] : removedContacts) {
+            if (v > version) {
+                delta.removed.push_back(wxid);
+            }
+        }
+    }
+    return delta;
 }
 
 int accept_new_friend(const std::string &v3, const std::string &v4, int scene)
@@ -97,25 +373,119 @@ int accept_new_friend(const std::string &v3, const std::string &v4, int scene)
 RpcContact_t get_contact_by_wxid(const string &wxid)
 {
     RpcContact_t contact;
-    LOG_ERROR("技术太菜，实现不了。");
+    find_cached(util::s2w(wxid), contact);
     return contact;
 }
 
-bool rpc_get_contacts(uint8_t *out, size_t *len)
+vector<string> get_contact_names(const vector<string> &wxids)
+{
+    vector<string> names;
+    names.reserve(wxids.size());
+
+    // 群成员里常有非好友，查不到时不提前刷新
+    refresh_cache(CACHE_REFRESH_INTERVAL);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (const auto &wxid : wxids) {
+        auto it = contactCache.find(util::s2w(wxid));
+        names.push_back(it == contactCache.end() ? "" : it->second.contact.name);
+    }
+    return names;
+}
+
+bool find_contact_name(const string &wxid, string &name)
 {
-    vector<RpcContact_t> contacts = get_contacts();
+    request_refresh();
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = contactCache.find(util::s2w(wxid));
+    if (it == contactCache.end()) {
+        return false;
+    }
+    name = it->second.contact.name;
+    return true;
+}
+
+void stop_refresh()
+{
+    {
+        std::lock_guard<std::mutex> lock(refresherMutex);
+        refresherStopped = true;
+        if (!refresherRunning) {
+            return;
+        }
+        refresherRunning = false;
+    }
+    refresherCv.notify_all();
+    if (refresher.joinable()) {
+        refresher.join();
+    }
+}
+
+void collect_stats(Stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    stats["contact.cached"]  = contactCache.size();
+    stats["contact.version"] = cacheVersion;
+}
+
+vector<RpcContact_t> get_contacts_by_wxids(const string &wxids)
+{
+    vector<RpcContact_t> contacts;
+    std::wstringstream wss(util::s2w(wxids));
+
+    for (wstring wxid; std::getline(wss, wxid, L',');) {
+        RpcContact_t contact;
+        if (find_cached(wxid, contact)) {
+            contacts.push_back(std::move(contact));
+        }
+    }
+    return contacts;
+}
+
+bool rpc_get_contacts(FieldMask_t mask, uint8_t *out, size_t *len)
+{
+    vector<RpcContact_t> contacts = get_contacts(mask);
+    Masked_t<vector<RpcContact_t>> masked { contacts, mask };
     return fill_response<Functions_FUNC_GET_CONTACTS>(out, len, [&](Response &rsp) {
         rsp.msg.contacts.contacts.funcs.encode = encode_contacts;
-        rsp.msg.contacts.contacts.arg          = &contacts;
+        rsp.msg.contacts.contacts.arg          = &masked;
     });
 }
 
-bool rpc_get_contact_info(const string &wxid, uint8_t *out, size_t *len)
+bool rpc_get_contact_info(const string &wxid, FieldMask_t mask, uint8_t *out, size_t *len)
 {
-    vector<RpcContact_t> contacts = { get_contact_by_wxid(wxid) };
+    vector<RpcContact_t> contacts;
+    RpcContact_t contact = get_contact_by_wxid(wxid);
+    if (!contact.wxid.empty()) {
+        contacts.push_back(std::move(contact));
+    }
+    Masked_t<vector<RpcContact_t>> masked { contacts, mask };
     return fill_response<Functions_FUNC_GET_CONTACT_INFO>(out, len, [&](Response &rsp) {
         rsp.msg.contacts.contacts.funcs.encode = encode_contacts;
-        rsp.msg.contacts.contacts.arg          = &contacts;
+        rsp.msg.contacts.contacts.arg          = &masked;
+    });
+}
+
+bool rpc_get_contacts_since(uint64_t version, FieldMask_t mask, uint8_t *out, size_t *len)
+{
+    ContactsDelta_t delta = get_contacts_since(version);
+    Masked_t<vector<RpcContact_t>> masked { delta.contacts, mask };
+    return fill_response<Functions_FUNC_GET_CONTACTS_SINCE>(out, len, [&](Response &rsp) {
+        rsp.msg.delta.version               = delta.version;
+        rsp.msg.delta.full                  = delta.full;
+        rsp.msg.delta.contacts.funcs.encode = encode_contacts;
+        rsp.msg.delta.contacts.arg          = &masked;
+        rsp.msg.delta.removed.funcs.encode  = encode_strings;
+        rsp.msg.delta.removed.arg           = &delta.removed;
+    });
+}
+
+bool rpc_get_contacts_by_wxids(const string &wxids, FieldMask_t mask, uint8_t *out, size_t *len)
+{
+    vector<RpcContact_t> contacts = get_contacts_by_wxids(wxids);
+    Masked_t<vector<RpcContact_t>> masked { contacts, mask };
+    return fill_response<Functions_FUNC_RESOLVE_CONTACTS>(out, len, [&](Response &rsp) {
+        rsp.msg.contacts.contacts.funcs.encode = encode_contacts;
+        rsp.msg.contacts.contacts.arg          = &masked;
     });
 }
 
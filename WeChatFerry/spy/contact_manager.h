@@ -10,12 +10,30 @@
 namespace contact
 {
 
-// 获取所有联系人
-std::vector<RpcContact_t> get_contacts();
+// 获取所有联系人，只计算 mask 中请求的字段
+std::vector<RpcContact_t> get_contacts(FieldMask_t mask = 0);
 
-// 根据 wxid 获取联系人信息
+// 获取 version 之后新增、变更和删除的联系人，version 为 0 或已过期时返回全量
+ContactsDelta_t get_contacts_since(uint64_t version);
+
+// 根据 wxid 获取联系人信息，查不到时 wxid 为空
 RpcContact_t get_contact_by_wxid(const std::string &wxid);
 
+// 批量获取联系人信息，wxids 以逗号分隔，查不到的跳过
+std::vector<RpcContact_t> get_contacts_by_wxids(const std::string &wxids);
+
+// 批量获取联系人昵称，与 wxids 一一对应，查不到的为空
+std::vector<std::string> get_contact_names(const std::vector<std::string> &wxids);
+
+// 从缓存中查联系人昵称，查不到返回 false；不在调用线程遍历，缓存过期时由后台线程刷新
+bool find_contact_name(const std::string &wxid, std::string &name);
+
+// 停止后台刷新线程
+void stop_refresh();
+
+// 缓存统计
+void collect_stats(Stats_t &stats);
+
 // 接受好友请求
 int accept_new_friend(const std::string &v3, const std::string &v4, int scene);
 
@@ -23,8 +41,10 @@ int accept_new_friend(const std::string &v3, const std::string &v4, int scene);
 // int add_friend_by_wxid(const std::string &wxid, const std::string &msg);
 
 // RPC 方法
-bool rpc_get_contacts(uint8_t *out, size_t *len);
-bool rpc_get_contact_info(const std::string &wxid, uint8_t *out, size_t *len);
+bool rpc_get_contacts(FieldMask_t mask, uint8_t *out, size_t *len);
+bool rpc_get_contacts_since(uint64_t version, FieldMask_t mask, uint8_t *out, size_t *len);
+bool rpc_get_contact_info(const std::string &wxid, FieldMask_t mask, uint8_t *out, size_t *len);
+bool rpc_get_contacts_by_wxids(const std::string &wxids, FieldMask_t mask, uint8_t *out, size_t *len);
 bool rpc_accept_friend(const Verification &v, uint8_t *out, size_t *len);
 
 } // namespace contact
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <iterator>
 
+#include "arrow_ipc.h"
 #include "log.hpp"
 #include "offsets.h"
 #include "pb_util.h"
@@ -81,7 +82,7 @@ static int cb_get_tables(void *ret, int argc, char **argv, char **azColName)
         if (strcmp(azColName[i], "name") == 0) {
             tbl.name = argv[i] ? argv[i] : "";
         } else if (strcmp(azColName[i], "sql") == 0) {
-            std::string sql(argv[i]);
+            std::string sql(argv[i] ? argv[i] : "");
             sql.erase(std::remove(sql.begin(), sql.end(), '\t'), sql.end());
             tbl.sql = sql;
         }
@@ -90,7 +91,7 @@ static int cb_get_tables(void *ret, int argc, char **argv, char **azColName)
     return 0;
 }
 
-DbTables_t get_db_tables(const std::string &db)
+DbTables_t get_db_tables(const std::string &db, FieldMask_t mask)
 {
     DbTables_t tables;
     if (db_map.empty()) {
@@ -102,26 +103,16 @@ DbTables_t get_db_tables(const std::string &db)
         return tables;
     }
 
-    constexpr const char *sql = "SELECT name FROM sqlite_master WHERE type='table';";
+    const char *sql = has_field(mask, DbTable_sql_tag) ? "SELECT name, sql FROM sqlite_master WHERE type='table';"
+                                                       : "SELECT name FROM sqlite_master WHERE type='table';";
     auto p_sqlite3_exec       = Spy::getFunction<Sqlite3_exec>(OsDb::EXEC);
     p_sqlite3_exec(it->second, sql, (Sqlite3_callback)cb_get_tables, (void *)&tables, nullptr);
 
     return tables;
 }
 
-DbRows_t exec_db_query(const std::string &db, const std::string &sql)
+static QWORD get_db_handle(const std::string &db)
 {
-    DbRows_t rows;
-
-    auto func_prepare      = Spy::getFunction<Sqlite3_prepare>(OsDb::PREPARE);
-    auto func_step         = Spy::getFunction<Sqlite3_step>(OsDb::STEP);
-    auto func_column_count = Spy::getFunction<Sqlite3_column_count>(OsDb::COLUMN_COUNT);
-    auto func_column_name  = Spy::getFunction<Sqlite3_column_name>(OsDb::COLUMN_NAME);
-    auto func_column_type  = Spy::getFunction<Sqlite3_column_type>(OsDb::COLUMN_TYPE);
-    auto func_column_blob  = Spy::getFunction<Sqlite3_column_blob>(OsDb::COLUMN_BLOB);
-    auto func_column_bytes = Spy::getFunction<Sqlite3_column_bytes>(OsDb::COLUMN_BYTES);
-    auto func_finalize     = Spy::getFunction<Sqlite3_finalize>(OsDb::FINALIZE);
-
     if (db_map.empty()) {
         db_map = get_db_handles();
     }
@@ -133,24 +124,53 @@ DbRows_t exec_db_query(const std::string &db, const std::string &sql)
         it     = db_map.find(db);
         if (it == db_map.end() || it->second == 0) {
             LOG_ERROR("Failed to get handle for database '{}'", db);
-            return rows;
+            return 0;
         }
     }
+    return it->second;
+}
+
+DbRows_t exec_db_query(const std::string &db, const std::string &sql, FieldMask_t mask)
+{
+    DbRows_t rows;
+
+    auto func_prepare      = Spy::getFunction<Sqlite3_prepare>(OsDb::PREPARE);
+    auto func_step         = Spy::getFunction<Sqlite3_step>(OsDb::STEP);
+    auto func_column_count = Spy::getFunction<Sqlite3_column_count>(OsDb::COLUMN_COUNT);
+    auto func_column_name  = Spy::getFunction<Sqlite3_column_name>(OsDb::COLUMN_NAME);
+    auto func_column_type  = Spy::getFunction<Sqlite3_column_type>(OsDb::COLUMN_TYPE);
+    auto func_column_blob  = Spy::getFunction<Sqlite3_column_blob>(OsDb::COLUMN_BLOB);
+    auto func_column_bytes = Spy::getFunction<Sqlite3_column_bytes>(OsDb::COLUMN_BYTES);
+    auto func_finalize     = Spy::getFunction<Sqlite3_finalize>(OsDb::FINALIZE);
+
+    QWORD handle = get_db_handle(db);
+    if (handle == 0) {
+        return rows;
+    }
 
     QWORD *stmt;
-    int rc = func_prepare(it->second, sql.c_str(), -1, &stmt, nullptr);
+    int rc = func_prepare(handle, sql.c_str(), -1, &stmt, nullptr);
     if (rc != SQLITE_OK) {
         LOG_ERROR("SQL prepare failed for '{}': error code {}", db, rc);
         return rows;
     }
 
+    bool want_column  = has_field(mask, DbField_column_tag);
+    bool want_content = has_field(mask, DbField_content_tag);
     while (func_step(stmt) == SQLITE_ROW) {
         DbRow_t row;
         int col_count = func_column_count(stmt);
         for (int i = 0; i < col_count; i++) {
             DbField_t field;
-            field.type   = func_column_type(stmt, i);
-            field.column = func_column_name(stmt, i);
+            field.type = func_column_type(stmt, i);
+            if (want_column) {
+                field.column = func_column_name(stmt, i);
+            }
+
+            if (!want_content) {
+                row.push_back(field);
+                continue;
+            }
 
             int length       = func_column_bytes(stmt, i);
             const void *blob = func_column_blob(stmt, i);
@@ -167,6 +187,225 @@ DbRows_t exec_db_query(const std::string &db, const std::string &sql)
     return rows;
 }
 
+// 能装下该 SQLite 值的最窄列类型；ColumnType 按 Int64 < Double < Utf8 < Binary 从窄到宽排列
+static arrow_ipc::ColumnType natural_type(int sql_type)
+{
+    switch (sql_type) {
+        case SQLITE_INTEGER:
+            return arrow_ipc::ColumnType::Int64;
+        case SQLITE_FLOAT:
+            return arrow_ipc::ColumnType::Double;
+        case SQLITE_TEXT:
+            return arrow_ipc::ColumnType::Utf8;
+        default:
+            return arrow_ipc::ColumnType::Binary;
+    }
+}
+
+// SQLite 是动态类型，按首批数据推断每列的 Arrow 类型，不窄于 floor（上一轮遇到冲突后放宽的类型）
+static std::vector<arrow_ipc::Column> infer_arrow_schema(const std::vector<std::string> &names, const DbRows_t &rows,
+                                                         const std::vector<arrow_ipc::ColumnType> &floor)
+{
+    std::vector<arrow_ipc::Column> schema;
+    for (size_t i = 0; i < names.size(); i++) {
+        bool seen                  = !floor.empty();
+        arrow_ipc::ColumnType type = seen ? floor[i] : arrow_ipc::ColumnType::Int64;
+        for (const auto &row : rows) {
+            if (row[i].type != SQLITE_NULL) {
+                type = std::max(type, natural_type(row[i].type));
+                seen = true;
+            }
+        }
+        schema.push_back({ names[i], seen ? type : arrow_ipc::ColumnType::Binary }); // 全为 NULL 时用 Binary
+    }
+    return schema;
+}
+
+// 数值列的内容是 sqlite3_column_blob 给出的文本形式；调用方保证值的类型不宽于列类型
+static void append_arrow_value(arrow_ipc::BatchBuilder &batch, size_t col, arrow_ipc::ColumnType type, int sql_type,
+                               const uint8_t *data, size_t len)
+{
+    if (sql_type == SQLITE_NULL) {
+        batch.append_null(col);
+        return;
+    }
+
+    if (type == arrow_ipc::ColumnType::Utf8 || type == arrow_ipc::ColumnType::Binary) {
+        batch.append_bytes(col, data, len);
+        return;
+    }
+
+    std::string text(reinterpret_cast<const char *>(data), len);
+    if (type == arrow_ipc::ColumnType::Double) {
+        batch.append_double(col, std::strtod(text.c_str(), nullptr));
+    } else {
+        batch.append_int64(col, std::strtoll(text.c_str(), nullptr, 10));
+    }
+}
+
+ArrowData_t exec_db_query_arrow(const std::string &db, const std::string &sql, uint32_t batch_rows, uint64_t offset,
+                                size_t max_bytes)
+{
+    constexpr uint32_t DEFAULT_BATCH_ROWS = 4096;
+    constexpr size_t MAX_BATCH_BYTES      = 4 * 1024 * 1024;
+    constexpr size_t RESERVED_BYTES       = 4096; // 元数据、EOS 等
+
+    ArrowData_t result { {}, false, offset };
+
+    auto func_prepare      = Spy::getFunction<Sqlite3_prepare>(OsDb::PREPARE);
+    auto func_step         = Spy::getFunction<Sqlite3_step>(OsDb::STEP);
+    auto func_column_count = Spy::getFunction<Sqlite3_column_count>(OsDb::COLUMN_COUNT);
+    auto func_column_name  = Spy::getFunction<Sqlite3_column_name>(OsDb::COLUMN_NAME);
+    auto func_column_type  = Spy::getFunction<Sqlite3_column_type>(OsDb::COLUMN_TYPE);
+    auto func_column_blob  = Spy::getFunction<Sqlite3_column_blob>(OsDb::COLUMN_BLOB);
+    auto func_column_bytes = Spy::getFunction<Sqlite3_column_bytes>(OsDb::COLUMN_BYTES);
+    auto func_finalize     = Spy::getFunction<Sqlite3_finalize>(OsDb::FINALIZE);
+
+    QWORD handle = get_db_handle(db);
+    if (handle == 0) {
+        return result;
+    }
+
+    if (batch_rows == 0) {
+        batch_rows = DEFAULT_BATCH_ROWS;
+    }
+
+    // 首批之后出现放不进列类型的值（如 TEXT 列里的 BLOB）时放宽该列，从头重新执行
+    // 每次至少放宽一列一级，最多 3 x 列数轮
+    std::vector<arrow_ipc::ColumnType> floor;
+    while (true) {
+        QWORD *stmt;
+        int rc = func_prepare(handle, sql.c_str(), -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            LOG_ERROR("SQL prepare failed for '{}': error code {}", db, rc);
+            result.ipc.clear();
+            return result;
+        }
+
+        int col_count = func_column_count(stmt);
+        std::vector<std::string> names;
+        for (int i = 0; i < col_count; i++) {
+            names.emplace_back(func_column_name(stmt, i));
+        }
+
+        // 跳过上次已返回的行
+        bool has_row = (func_step(stmt) == SQLITE_ROW);
+        for (uint64_t skipped = 0; has_row && skipped < offset; skipped++) {
+            has_row = (func_step(stmt) == SQLITE_ROW);
+        }
+
+        // 先缓存第一批用来推断列类型，之后逐行直接写入列缓冲区
+        // 先取 column_type 再取 column_bytes：取字节数会把数值转成文本，之后的 column_type 不再可靠
+        DbRows_t first;
+        for (; has_row && first.size() < batch_rows; has_row = (func_step(stmt) == SQLITE_ROW)) {
+            DbRow_t row;
+            for (int i = 0; i < col_count; i++) {
+                DbField_t field;
+                field.type       = func_column_type(stmt, i);
+                int length       = func_column_bytes(stmt, i);
+                const void *blob = func_column_blob(stmt, i);
+                if (length > 0 && field.type != SQLITE_NULL) {
+                    auto *p = static_cast<const uint8_t *>(blob);
+                    field.content.assign(p, p + length);
+                }
+                row.push_back(std::move(field));
+            }
+            first.push_back(std::move(row));
+        }
+
+        auto schema = infer_arrow_schema(names, first, floor);
+        result.ipc.clear();
+        result.truncated = false;
+        arrow_ipc::StreamWriter writer(result.ipc);
+        arrow_ipc::BatchBuilder batch(schema);
+        writer.write_schema(schema);
+
+        size_t limit     = max_bytes > RESERVED_BYTES ? max_bytes - RESERVED_BYTES : 0;
+        uint64_t emitted = 0;
+        // 控制单批大小，并保证整个 Stream 能放进响应缓冲区
+        auto reserve_row = [&](size_t row_bytes) {
+            if (result.ipc.size() + batch.body_size() + row_bytes > limit) {
+                result.truncated = true;
+                return false;
+            }
+            if (batch.rows() >= batch_rows || batch.body_size() + row_bytes > MAX_BATCH_BYTES) {
+                writer.write_batch(batch);
+                batch.clear();
+            }
+            return true;
+        };
+
+        for (const auto &row : first) {
+            size_t row_bytes = 0;
+            for (const auto &field : row) {
+                row_bytes += field.content.size() + 16;
+            }
+            if (!reserve_row(row_bytes)) {
+                break;
+            }
+            for (int i = 0; i < col_count; i++) {
+                append_arrow_value(batch, i, schema[i].type, row[i].type, row[i].content.data(), row[i].content.size());
+            }
+            batch.finish_row();
+            emitted++;
+        }
+
+        bool conflict = false;
+        std::vector<int> types(col_count);
+        for (; has_row && !result.truncated; has_row = (func_step(stmt) == SQLITE_ROW)) {
+            for (int i = 0; i < col_count; i++) {
+                types[i] = func_column_type(stmt, i);
+                if (types[i] != SQLITE_NULL && natural_type(types[i]) > schema[i].type) {
+                    LOG_WARN("Arrow column '{}' of '{}' widened for type {}", names[i], db, types[i]);
+                    schema[i].type = natural_type(types[i]);
+                    conflict       = true;
+                }
+            }
+            if (conflict) {
+                break;
+            }
+
+            size_t row_bytes = 0;
+            for (int i = 0; i < col_count; i++) {
+                row_bytes += func_column_bytes(stmt, i) + 16;
+            }
+            if (!reserve_row(row_bytes)) {
+                break;
+            }
+            for (int i = 0; i < col_count; i++) {
+                int length       = func_column_bytes(stmt, i);
+                const void *blob = func_column_blob(stmt, i);
+                append_arrow_value(batch, i, schema[i].type, types[i], static_cast<const uint8_t *>(blob),
+                                   (length > 0) ? length : 0);
+            }
+            batch.finish_row();
+            emitted++;
+        }
+        func_finalize(stmt);
+
+        if (conflict) {
+            floor.clear();
+            for (const auto &column : schema) {
+                floor.push_back(column.type);
+            }
+            continue;
+        }
+
+        if (batch.rows() > 0) {
+            writer.write_batch(batch);
+        }
+        writer.write_eos();
+        result.next_offset = offset + emitted;
+        break;
+    }
+
+    if (result.truncated) {
+        // 单行就超过上限时 next_offset 不前进，需调大响应缓冲区或在 SQL 里截短该列
+        LOG_WARN("Arrow result of '{}' exceeds {} bytes, truncated at row {}", db, max_bytes, result.next_offset);
+    }
+    return result;
+}
+
 int get_local_id_and_dbidx(uint64_t id, uint64_t *local_id, uint32_t *db_idx)
 {
     if (!local_id || !db_idx) {
@@ -245,6 +484,49 @@ std::vector<uint8_t> get_audio_data(uint64_t id)
     return {};
 }
 
+std::unordered_map<uint64_t, std::vector<uint8_t>> get_audio_data(const std::vector<uint64_t> &msg_ids)
+{
+    std::unordered_map<uint64_t, std::vector<uint8_t>> found;
+    std::vector<uint64_t> pending(msg_ids);
+    std::sort(pending.begin(), pending.end());
+    pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+    QWORD msg_mgr_addr = util::get_qword(Spy::WeChatDll.load() + OsDb::MSG_I);
+    int db_index       = static_cast<int>(util::get_qword(msg_mgr_addr + 0x68));
+
+    // 每个库过一遍，IN 列表按组拆开；已找到的不再去更早的库里查
+    constexpr size_t MAX_IN_IDS = 500;
+    for (int i = db_index - 1; i >= 0 && !pending.empty(); i--) {
+        std::string dbname = "MediaMSG" + std::to_string(i) + ".db";
+        for (size_t from = 0; from < pending.size(); from += MAX_IN_IDS) {
+            size_t to       = std::min(pending.size(), from + MAX_IN_IDS);
+            std::string sql = "SELECT Reserved0, Buf FROM Media WHERE Reserved0 IN (";
+            for (size_t k = from; k < to; k++) {
+                sql += (k > from ? "," : "") + std::to_string(pending[k]);
+            }
+            sql += ");";
+
+            DbRows_t rows = exec_db_query(dbname, sql);
+            for (const auto &row : rows) {
+                if (row.size() < 2 || row[0].column != "Reserved0" || row[1].column != "Buf"
+                    || row[1].content.empty()) {
+                    continue;
+                }
+
+                std::string id_str(row[0].content.begin(), row[0].content.end());
+                uint64_t id = std::strtoull(id_str.c_str(), nullptr, 10);
+                auto begin  = row[1].content.begin() + (row[1].content.front() == 0x02 ? 1 : 0); // 同 get_audio_data
+                found.emplace(id, std::vector<uint8_t>(begin, row[1].content.end()));
+            }
+        }
+
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [&](uint64_t id) { return found.count(id); }),
+                      pending.end());
+    }
+
+    return found;
+}
+
 bool rpc_get_db_names(uint8_t *out, size_t *len)
 {
     DbNames_t names = get_db_names();
@@ -254,23 +536,38 @@ bool rpc_get_db_names(uint8_t *out, size_t *len)
     });
 }
 
-bool rpc_get_db_tables(const std::string &db, uint8_t *out, size_t *len)
+bool rpc_get_db_tables(const std::string &db, FieldMask_t mask, uint8_t *out, size_t *len)
 {
-    DbTables_t tables = get_db_tables(db);
+    DbTables_t tables = get_db_tables(db, mask);
+    Masked_t<DbTables_t> masked { tables, mask };
     return fill_response<Functions_FUNC_GET_DB_TABLES>(out, len, [&](Response &rsp) {
         rsp.msg.tables.tables.funcs.encode = encode_tables;
-        rsp.msg.tables.tables.arg          = &tables;
+        rsp.msg.tables.tables.arg          = &masked;
     });
 }
 
-bool rpc_exec_db_query(const DbQuery query, uint8_t *out, size_t *len)
+bool rpc_exec_db_query(const DbQuery query, FieldMask_t mask, uint8_t *out, size_t *len)
 {
     const std::string db(query.db);
     const std::string sql(query.sql);
-    DbRows_t rows = exec_db_query(db, sql);
+    DbRows_t rows = exec_db_query(db, sql, mask);
+    Masked_t<DbRows_t> masked { rows, mask };
     return fill_response<Functions_FUNC_EXEC_DB_QUERY>(out, len, [&](Response &rsp) {
         rsp.msg.rows.rows.funcs.encode = encode_rows;
-        rsp.msg.rows.rows.arg          = &rows;
+        rsp.msg.rows.rows.arg          = &masked;
+    });
+}
+
+bool rpc_exec_db_query_arrow(const DbQuery query, uint8_t *out, size_t *len)
+{
+    const std::string db(query.db);
+    const std::string sql(query.sql);
+    ArrowData_t arrow = exec_db_query_arrow(db, sql, query.batch, query.offset, *len);
+    return fill_response<Functions_FUNC_EXEC_DB_ARROW>(out, len, [&](Response &rsp) {
+        rsp.msg.arrow.data.funcs.encode = encode_bytes;
+        rsp.msg.arrow.data.arg          = &arrow.ipc;
+        rsp.msg.arrow.truncated         = arrow.truncated;
+        rsp.msg.arrow.next_offset       = arrow.next_offset;
     });
 }
 
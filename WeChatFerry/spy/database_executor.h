@@ -2,6 +2,7 @@
 
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "wcf.pb.h"
@@ -15,10 +16,15 @@ namespace db
 DbNames_t get_db_names();
 
 // 获取指定数据库的表列表
-DbTables_t get_db_tables(const std::string &db);
+DbTables_t get_db_tables(const std::string &db, FieldMask_t mask = 0);
 
-// 执行 SQL 查询
-DbRows_t exec_db_query(const std::string &db, const std::string &sql);
+// 执行 SQL 查询，mask 为 DbField 的字段掩码
+DbRows_t exec_db_query(const std::string &db, const std::string &sql, FieldMask_t mask = 0);
+
+// 执行 SQL 查询，跳过前 offset 行，结果编码为 Arrow IPC Stream，总长度不超过 max_bytes
+// 放不下时 truncated 为 true，用 next_offset 再查一次接着读
+ArrowData_t exec_db_query_arrow(const std::string &db, const std::string &sql, uint32_t batch_rows, uint64_t offset,
+                                size_t max_bytes);
 
 // 获取本地消息 ID 和数据库索引
 int get_local_id_and_dbidx(uint64_t id, uint64_t *local_id, uint32_t *db_idx);
@@ -26,9 +32,13 @@ int get_local_id_and_dbidx(uint64_t id, uint64_t *local_id, uint32_t *db_idx);
 // 获取音频数据
 std::vector<uint8_t> get_audio_data(uint64_t msg_id);
 
+// 批量获取音频数据，每个 MediaMSG 库过一遍，每次查询最多 500 个 id，找不到的 id 不在结果中
+std::unordered_map<uint64_t, std::vector<uint8_t>> get_audio_data(const std::vector<uint64_t> &msg_ids);
+
 // RPC 方法
 bool rpc_get_db_names(uint8_t *out, size_t *len);
-bool rpc_get_db_tables(const std::string &db, uint8_t *out, size_t *len);
-bool rpc_exec_db_query(const DbQuery query, uint8_t *out, size_t *len);
+bool rpc_get_db_tables(const std::string &db, FieldMask_t mask, uint8_t *out, size_t *len);
+bool rpc_exec_db_query(const DbQuery query, FieldMask_t mask, uint8_t *out, size_t *len);
+bool rpc_exec_db_query_arrow(const DbQuery query, uint8_t *out, size_t *len);
 
 } // namespace db
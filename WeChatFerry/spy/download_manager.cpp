@@ -0,0 +1,387 @@
+﻿#include "download_manager.h"
+
+#include <algorithm>
+#include <ctime>
+
+#include "log.hpp"
+#include "message_handler.h"
+#include "misc_manager.h"
+#include "rpc_helper.h"
+
+namespace misc
+{
+namespace fs = std::filesystem;
+
+#define MAX_QUEUE_SIZE   4096
+#define MAX_RESULT_COUNT 4096
+
+static constexpr auto POLL_INTERVAL = std::chrono::milliseconds(200);
+
+static uint32_t elapsed_ms(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count());
+}
+
+DownloadManager &DownloadManager::get_instance()
+{
+    static DownloadManager instance;
+    return instance;
+}
+
+DownloadManager::~DownloadManager() { stop(); }
+
+uint64_t DownloadManager::submit(uint64_t msgid, const std::string &thumb, const std::string &extra)
+{
+    if (thumb.empty() && extra.empty()) {
+        LOG_ERROR("文件地址不能全为空");
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+        // stop() 放锁后才 join，这时重启会给还没 join 的 worker_ 赋值
+        return 0;
+    }
+    auto dup = byMsg_.find(msgid);
+    if (dup != byMsg_.end()) {
+        return dup->second;
+    }
+    if (queue_.size() >= MAX_QUEUE_SIZE) {
+        LOG_ERROR("下载队列已满: {}", queue_.size());
+        return 0;
+    }
+
+    uint64_t id = nextId_++;
+    Task task   = {};
+    task.id     = id;
+    task.msgid  = msgid;
+    task.thumb  = thumb;
+    task.extra  = extra;
+    task.queued = Clock::now();
+    tasks_.emplace(id, std::move(task));
+    byMsg_[msgid] = id;
+    queue_.push_back(id);
+    results_[id] = { id, msgid, "", 0, DownloadResult_State_QUEUED, 0, 0, 0 };
+    resultOrder_.push_back(id);
+
+    if (!running_) {
+        running_ = true;
+        worker_  = std::thread(&DownloadManager::run, this);
+    }
+    cv_.notify_one();
+    return id;
+}
+
+DownloadResult_t DownloadManager::query(uint64_t job) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = results_.find(job);
+    if (it == results_.end()) {
+        return { job, 0, "", 0, DownloadResult_State_UNKNOWN, 0, 0, 0 };
+    }
+    return it->second;
+}
+
+int DownloadManager::cancel(uint64_t job)
+{
+    std::vector<DownloadResult_t> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = tasks_.find(job);
+        if (it == tasks_.end()) {
+            return -1;
+        }
+        if (it->second.running) {
+            active_--;
+        } else {
+            queue_.erase(std::remove(queue_.begin(), queue_.end(), job), queue_.end());
+        }
+        finish(job, DownloadResult_State_CANCELLED, 0, finished);
+    }
+    cv_.notify_one();
+    publish(finished);
+    return 0;
+}
+
+int DownloadManager::set_limits(const DownloadLimits &limits)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (limits.max_active) {
+            maxActive_ = limits.max_active;
+        }
+        if (limits.timeout_ms) {
+            timeoutMs_ = limits.timeout_ms;
+        }
+        if (limits.stable_ms) {
+            stableMs_ = limits.stable_ms;
+        }
+        LOG_INFO("Download limits: active {}, timeout {}ms, stable {}ms", maxActive_, timeoutMs_, stableMs_);
+    }
+    cv_.notify_one();
+    return 0;
+}
+
+void DownloadManager::set_listener(std::function<void(const DownloadResult_t &)> listener)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    listener_ = std::move(listener);
+}
+
+void DownloadManager::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+
+    std::vector<DownloadResult_t> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!tasks_.empty()) {
+            finish(tasks_.begin()->first, DownloadResult_State_CANCELLED, 0, finished);
+        }
+        queue_.clear();
+        active_ = 0;
+    }
+    // 排队和下载中的任务也推送取消结果，客户端不用一直等
+    publish(finished);
+}
+
+void DownloadManager::finish(uint64_t id, int32_t state, int32_t status, std::vector<DownloadResult_t> &finished)
+{
+    auto it = tasks_.find(id);
+    if (it == tasks_.end()) {
+        return;
+    }
+
+    auto now   = Clock::now();
+    Task &task = it->second;
+    auto &r    = results_[id];
+    r.path     = task.path.generic_string();
+    r.size     = task.size;
+    r.state    = state;
+    r.status   = status;
+    if (task.running) {
+        r.wait_ms = elapsed_ms(task.queued, task.started);
+        r.run_ms  = elapsed_ms(task.started, now);
+    } else {
+        r.wait_ms = elapsed_ms(task.queued, now);
+    }
+    finished.push_back(r);
+
+    switch (state) {
+        case DownloadResult_State_DONE:
+            done_++;
+            break;
+        case DownloadResult_State_TIMEOUT:
+            timeouts_++;
+            break;
+        case DownloadResult_State_CANCELLED:
+            cancelled_++;
+            break;
+        default:
+            failed_++;
+            break;
+    }
+
+    byMsg_.erase(task.msgid);
+    tasks_.erase(it);
+
+    // 只淘汰已结束的结果
+    while (results_.size() > MAX_RESULT_COUNT && !resultOrder_.empty()) {
+        auto old = results_.find(resultOrder_.front());
+        if (old != results_.end() && old->second.state <= DownloadResult_State_RUNNING) {
+            break;
+        }
+        if (old != results_.end()) {
+            results_.erase(old);
+        }
+        resultOrder_.pop_front();
+    }
+}
+
+void DownloadManager::start_next(std::unique_lock<std::mutex> &lock, std::vector<DownloadResult_t> &finished)
+{
+    while (running_ && active_ < maxActive_ && !queue_.empty()) {
+        uint64_t id = queue_.front();
+        queue_.pop_front();
+        auto it = tasks_.find(id);
+        if (it == tasks_.end()) {
+            continue;
+        }
+
+        Task &task         = it->second;
+        task.running       = true;
+        task.started       = Clock::now();
+        task.changed       = task.started;
+        results_[id].state = DownloadResult_State_RUNNING;
+        uint64_t msgid     = task.msgid;
+        std::string thumb  = task.thumb;
+        std::string extra  = task.extra;
+        active_++;
+
+        // 调微信的函数时不持锁，期间可以继续提交和查询
+        lock.unlock();
+        fs::path path;
+        int status = -1;
+        try {
+            status = download_attachment(msgid, thumb, extra, path);
+        } catch (const std::exception &e) {
+            LOG_ERROR("下载附件失败: {}, {}", msgid, e.what());
+        }
+        lock.lock();
+
+        it = tasks_.find(id);
+        if (it == tasks_.end()) {
+            continue; // 期间被取消了
+        }
+        it->second.path = path;
+        if (status != 0 || path.empty()) {
+            active_--;
+            finish(id, DownloadResult_State_FAILED, status, finished);
+        }
+    }
+}
+
+void DownloadManager::poll(Clock::time_point now, std::vector<DownloadResult_t> &finished)
+{
+    std::vector<std::pair<uint64_t, int32_t>> ended;
+    for (auto &[id, task] : tasks_) {
+        if (!task.running) {
+            continue;
+        }
+
+        // 微信边下边写，文件存在且大小一段时间不变才算写完
+        std::error_code ec;
+        uint64_t size = fs::file_size(task.path, ec);
+        if (!ec && size != task.size) {
+            task.size    = size;
+            task.changed = now;
+        } else if (!ec && size > 0 && now - task.changed >= std::chrono::milliseconds(stableMs_)) {
+            ended.emplace_back(id, DownloadResult_State_DONE);
+            continue;
+        }
+        if (now - task.started >= std::chrono::milliseconds(timeoutMs_)) {
+            ended.emplace_back(id, DownloadResult_State_TIMEOUT);
+        }
+    }
+
+    for (const auto &[id, state] : ended) {
+        active_--;
+        finish(id, state, 0, finished);
+    }
+}
+
+void DownloadManager::publish(std::vector<DownloadResult_t> &finished)
+{
+    std::function<void(const DownloadResult_t &)> listener;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listener = listener_;
+    }
+    if (listener) {
+        for (const auto &r : finished) {
+            listener(r);
+        }
+    }
+
+    auto &handler = message::Handler::getInstance();
+    if (!handler.isMessageListening()) {
+        return;
+    }
+    for (auto &r : finished) {
+        WxMsg_t msg = {};
+        msg.type    = DOWNLOAD_RESULT_MSG_TYPE;
+        msg.ts      = static_cast<uint32_t>(time(nullptr));
+        msg.dl      = std::move(r);
+        handler.pushMessage(std::move(msg));
+    }
+}
+
+void DownloadManager::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        std::vector<DownloadResult_t> finished;
+        start_next(lock, finished);
+        poll(Clock::now(), finished);
+
+        if (!finished.empty()) {
+            lock.unlock();
+            publish(finished);
+            lock.lock();
+            continue; // 有任务结束，马上补位
+        }
+
+        auto ready = [this] { return !running_ || (active_ < maxActive_ && !queue_.empty()); };
+        if (active_ == 0) {
+            cv_.wait(lock, ready);
+        } else {
+            cv_.wait_for(lock, POLL_INTERVAL, ready);
+        }
+    }
+}
+
+void DownloadManager::collect_stats(Stats_t &stats) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats["download.queued"]    = queue_.size();
+    stats["download.active"]    = active_;
+    stats["download.submitted"] = nextId_ - 1;
+    stats["download.done"]      = done_;
+    stats["download.failed"]    = failed_;
+    stats["download.timeout"]   = timeouts_;
+    stats["download.cancelled"] = cancelled_;
+}
+
+bool DownloadManager::rpc_submit(const AttachMsg &att, uint8_t *out, size_t *len)
+{
+    uint64_t job = submit(att.id, att.thumb ? att.thumb : "", att.extra ? att.extra : "");
+    // 成功时返回任务 id，失败时返回 status -1
+    return fill_response<Functions_FUNC_DOWNLOAD_ASYNC>(out, len, [&](Response &rsp) {
+        if (job == 0) {
+            rsp.which_msg  = Response_status_tag;
+            rsp.msg.status = -1;
+        } else {
+            rsp.msg.job = job;
+        }
+    });
+}
+
+bool DownloadManager::rpc_query(uint64_t job, uint8_t *out, size_t *len)
+{
+    DownloadResult_t result = query(job);
+    return fill_response<Functions_FUNC_GET_DOWNLOAD>(out, len, [&](Response &rsp) {
+        rsp.msg.dl.job     = result.job;
+        rsp.msg.dl.id      = result.id;
+        rsp.msg.dl.path    = const_cast<char *>(result.path.c_str());
+        rsp.msg.dl.size    = result.size;
+        rsp.msg.dl.state   = static_cast<DownloadResult_State>(result.state);
+        rsp.msg.dl.status  = result.status;
+        rsp.msg.dl.wait_ms = result.wait_ms;
+        rsp.msg.dl.run_ms  = result.run_ms;
+    });
+}
+
+bool DownloadManager::rpc_cancel(uint64_t job, uint8_t *out, size_t *len)
+{
+    return fill_response<Functions_FUNC_CANCEL_DOWNLOAD>(out, len,
+                                                         [&](Response &rsp) { rsp.msg.status = cancel(job); });
+}
+
+bool DownloadManager::rpc_set_limits(const DownloadLimits &limits, uint8_t *out, size_t *len)
+{
+    return fill_response<Functions_FUNC_SET_DOWNLOAD_LIMIT>(
+        out, len, [&](Response &rsp) { rsp.msg.status = set_limits(limits); });
+}
+
+} // namespace misc
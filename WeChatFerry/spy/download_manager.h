@@ -0,0 +1,101 @@
+﻿#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "wcf.pb.h"
+
+#include "pb_types.h"
+
+namespace misc
+{
+
+// 附件下载结果的消息类型
+constexpr uint32_t DOWNLOAD_RESULT_MSG_TYPE = 0x10004;
+
+// 附件下载管理：任务排队提交给微信，同时最多下载 max_active 个，之后轮询目标文件直到大小不再变化
+// 结束后结果以 DOWNLOAD_RESULT_MSG_TYPE 消息推送（需开启消息接收），也可用 FUNC_GET_DOWNLOAD 查询
+class DownloadManager
+{
+public:
+    static DownloadManager &get_instance();
+
+    // 同一条消息在排队或下载中时返回已有的任务 id，stop() 之后返回 0
+    uint64_t submit(uint64_t msgid, const std::string &thumb, const std::string &extra);
+    DownloadResult_t query(uint64_t job) const;
+
+    // 排队中的直接移除；已提交给微信的无法撤回，只是不再等待
+    int cancel(uint64_t job);
+    int set_limits(const DownloadLimits &limits);
+    // 每个任务结束时在下载线程回调（不持锁），用于预取等内部调用方跟踪自己提交的任务
+    void set_listener(std::function<void(const DownloadResult_t &)> listener);
+    void stop();
+    void collect_stats(Stats_t &stats) const;
+
+    // RPC 方法
+    bool rpc_submit(const AttachMsg &att, uint8_t *out, size_t *len);
+    bool rpc_query(uint64_t job, uint8_t *out, size_t *len);
+    bool rpc_cancel(uint64_t job, uint8_t *out, size_t *len);
+    bool rpc_set_limits(const DownloadLimits &limits, uint8_t *out, size_t *len);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task {
+        uint64_t id;
+        uint64_t msgid;
+        std::string thumb;
+        std::string extra;
+        std::filesystem::path path;
+        uint64_t size = 0;
+        bool running  = false;
+        Clock::time_point queued;
+        Clock::time_point started;
+        Clock::time_point changed; // 上次看到文件大小变化
+    };
+
+    DownloadManager() = default;
+    ~DownloadManager();
+
+    DownloadManager(const DownloadManager &)            = delete;
+    DownloadManager &operator=(const DownloadManager &) = delete;
+
+    void run();
+    void publish(std::vector<DownloadResult_t> &finished);
+    // 以下调用方需持有 mutex_，结束的结果追加到 finished，解锁后再推送
+    void start_next(std::unique_lock<std::mutex> &lock, std::vector<DownloadResult_t> &finished);
+    void poll(Clock::time_point now, std::vector<DownloadResult_t> &finished);
+    void finish(uint64_t id, int32_t state, int32_t status, std::vector<DownloadResult_t> &finished);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<uint64_t> queue_;
+    std::unordered_map<uint64_t, Task> tasks_;     // 排队和下载中的任务
+    std::unordered_map<uint64_t, uint64_t> byMsg_; // 消息 id -> 任务 id
+    std::unordered_map<uint64_t, DownloadResult_t> results_;
+    std::deque<uint64_t> resultOrder_;
+    std::function<void(const DownloadResult_t &)> listener_;
+    std::thread worker_;
+    bool running_       = false;
+    bool stopped_       = false; // stop() 之后不再接受任务
+    uint64_t nextId_    = 1;
+    size_t active_      = 0;
+    size_t maxActive_   = 4;
+    uint32_t timeoutMs_ = 60000;
+    uint32_t stableMs_  = 1000;
+    uint64_t done_      = 0;
+    uint64_t failed_    = 0;
+    uint64_t timeouts_  = 0;
+    uint64_t cancelled_ = 0;
+};
+
+} // namespace misc
@@ -0,0 +1,155 @@
+﻿#include "keyword_engine.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "aho_corasick.h"
+#include "log.hpp"
+#include "rpc_helper.h"
+
+namespace keyword
+{
+
+struct Rule {
+    uint32_t id;
+    std::unordered_set<std::string> rooms;
+    std::unordered_set<std::string> senders;
+    std::unordered_set<uint32_t> types;
+};
+
+// 编译后的规则集，建好后只读；替换时整体换指针，正在匹配的线程继续用旧的
+struct Engine {
+    std::vector<Rule> rules;
+    std::vector<std::vector<uint32_t>> wordRules; // 关键词下标 -> 规则下标
+    std::unique_ptr<util::AhoCorasick> matcher;
+    bool suppress = false;
+};
+
+static std::shared_ptr<const Engine> engine;
+static std::atomic<uint64_t> evaluated { 0 };
+static std::atomic<uint64_t> matched { 0 };
+static std::atomic<uint64_t> suppressed { 0 };
+
+static std::shared_ptr<const Engine> current() { return std::atomic_load(&engine); }
+
+static bool in_scope(const Rule &rule, const WxMsg_t &msg)
+{
+    if (!rule.types.empty() && rule.types.count(msg.type) == 0) return false;
+    if (!rule.rooms.empty() && (!msg.is_group || rule.rooms.count(msg.roomid) == 0)) return false;
+    if (!rule.senders.empty() && rule.senders.count(msg.sender) == 0) return false;
+    return true;
+}
+
+int set_rules(const KeywordRules &rules)
+{
+    if (rules.rules_count == 0) {
+        std::atomic_store(&engine, std::shared_ptr<const Engine>());
+        LOG_INFO("Keyword rules cleared");
+        return 0;
+    }
+
+    auto next      = std::make_shared<Engine>();
+    next->suppress = rules.suppress;
+    next->rules.reserve(rules.rules_count);
+
+    // 相同的关键词只进自动机一次，命中时展开到所有引用它的规则
+    std::vector<std::string> words;
+    std::unordered_map<std::string, uint32_t> wordIndex;
+    for (pb_size_t i = 0; i < rules.rules_count; i++) {
+        const KeywordRule &kr = rules.rules[i];
+        uint32_t ruleIdx      = static_cast<uint32_t>(next->rules.size());
+        size_t added          = 0;
+        for (pb_size_t j = 0; j < kr.words_count; j++) {
+            if (kr.words[j] == nullptr || kr.words[j][0] == '\0') continue;
+            auto [it, inserted] = wordIndex.emplace(kr.words[j], static_cast<uint32_t>(words.size()));
+            if (inserted) {
+                words.emplace_back(kr.words[j]);
+                next->wordRules.emplace_back();
+            }
+            auto &refs = next->wordRules[it->second];
+            if (refs.empty() || refs.back() != ruleIdx) {
+                refs.push_back(ruleIdx);
+            }
+            added++;
+        }
+        if (added == 0) {
+            LOG_ERROR("Keyword rule {} has no words", kr.id);
+            return -1;
+        }
+
+        Rule rule { kr.id };
+        for (pb_size_t j = 0; j < kr.rooms_count; j++) {
+            if (kr.rooms[j]) rule.rooms.emplace(kr.rooms[j]);
+        }
+        for (pb_size_t j = 0; j < kr.senders_count; j++) {
+            if (kr.senders[j]) rule.senders.emplace(kr.senders[j]);
+        }
+        rule.types.insert(kr.types, kr.types + kr.types_count);
+        next->rules.push_back(std::move(rule));
+    }
+
+    next->matcher = std::make_unique<util::AhoCorasick>(words);
+    LOG_INFO("Keyword rules loaded: {} rules, {} words, {} states", next->rules.size(), words.size(),
+             next->matcher->states());
+    std::atomic_store(&engine, std::shared_ptr<const Engine>(std::move(next)));
+    return static_cast<int>(rules.rules_count);
+}
+
+bool is_active() { return current() != nullptr; }
+
+bool apply(WxMsg_t &msg)
+{
+    auto e = current();
+    if (!e || is_notice(msg)) {
+        return true;
+    }
+
+    evaluated++;
+    // 0: 未检查，1: 命中，2: 不在范围内；范围只在规则第一次被关键词命中时检查
+    std::vector<uint8_t> state(e->rules.size(), 0);
+    e->matcher->match(msg.content, [&](uint32_t word) {
+        for (uint32_t r : e->wordRules[word]) {
+            if (state[r] == 0) {
+                state[r] = in_scope(e->rules[r], msg) ? 1 : 2;
+            }
+        }
+    });
+
+    msg.rule_ids.clear();
+    for (size_t r = 0; r < state.size(); r++) {
+        if (state[r] == 1) msg.rule_ids.push_back(e->rules[r].id);
+    }
+
+    if (!msg.rule_ids.empty()) {
+        matched++;
+        return true;
+    }
+    if (e->suppress) {
+        suppressed++;
+        return false;
+    }
+    return true;
+}
+
+void collect_stats(Stats_t &stats)
+{
+    auto e                      = current();
+    stats["keyword.rules"]      = e ? e->rules.size() : 0;
+    stats["keyword.words"]      = e ? e->wordRules.size() : 0;
+    stats["keyword.states"]     = e ? e->matcher->states() : 0;
+    stats["keyword.evaluated"]  = evaluated.load();
+    stats["keyword.matched"]    = matched.load();
+    stats["keyword.suppressed"] = suppressed.load();
+}
+
+bool rpc_set_rules(const KeywordRules &rules, uint8_t *out, size_t *len)
+{
+    return fill_response<Functions_FUNC_SET_KEYWORD_RULES>(out, len,
+                                                            [&](Response &rsp) { rsp.msg.status = set_rules(rules); });
+}
+
+} // namespace keyword
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "wcf.pb.h"
+
+#include "pb_types.h"
+
+namespace keyword
+{
+
+// 编译并整体替换关键词规则，旧规则在替换前后都不影响正在推送的消息
+// 返回规则数，规则为空时关闭匹配，出错返回 -1
+int set_rules(const KeywordRules &rules);
+
+// 是否已加载规则
+bool is_active();
+
+// 匹配 content 并按群、发送者、类型过滤，命中的规则 id 写入 msg.rule_ids
+// 返回是否需要推送：开启 suppress 时未命中的普通消息返回 false
+bool apply(WxMsg_t &msg);
+
+// 规则与匹配统计
+void collect_stats(Stats_t &stats);
+
+// RPC 方法
+bool rpc_set_rules(const KeywordRules &rules, uint8_t *out, size_t *len);
+
+} // namespace keyword
@@ -0,0 +1,311 @@
+﻿#include "media_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "log.hpp"
+#include "rpc_helper.h"
+
+namespace misc
+{
+namespace fs = std::filesystem;
+
+static constexpr uint64_t DEFAULT_CACHE_BUDGET = 512ULL << 20;
+static constexpr const char *TEMP_SUFFIX       = ".tmp";
+
+static inline void fnv1a(uint64_t &h, const void *data, size_t len)
+{
+    auto p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+}
+
+static std::string to_hex(uint64_t v)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+    return buf;
+}
+
+// 缓存文件名，跨进程、跨版本保持不变，不能用 std::hash
+static std::string entry_name(const std::string &key)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    fnv1a(h, key.data(), key.size());
+    return to_hex(h);
+}
+
+// 同一目录下不同线程、不同进程的临时文件不重名
+fs::path make_temp_path(const fs::path &path)
+{
+    static std::atomic<uint64_t> seq { 0 };
+    uint64_t h = 0xCBF29CE484222325ULL;
+    auto now   = std::chrono::steady_clock::now().time_since_epoch().count();
+    fnv1a(h, &now, sizeof(now));
+    uint64_t n = seq++;
+    fnv1a(h, &n, sizeof(n));
+    return path.string() + "." + to_hex(h) + TEMP_SUFFIX;
+}
+
+bool commit_temp_file(const fs::path &tmp, const fs::path &path)
+{
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        LOG_ERROR("重命名失败: {} -> {}, {}", tmp.string(), path.string(), ec.message());
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool write_file_atomic(const fs::path &path, const uint8_t *data, size_t len)
+{
+    fs::path tmp = make_temp_path(path);
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(data), len);
+        out.close();
+        if (!out) {
+            LOG_ERROR("写入文件失败: {}", tmp.string());
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+    return commit_temp_file(tmp, path);
+}
+
+bool copy_file_atomic(const fs::path &from, const fs::path &to)
+{
+    fs::path tmp = make_temp_path(to);
+    std::error_code ec;
+    fs::copy_file(from, tmp, fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+        LOG_ERROR("复制文件失败: {} -> {}, {}", from.string(), tmp.string(), ec.message());
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return commit_temp_file(tmp, to);
+}
+
+MediaCache &MediaCache::get_instance()
+{
+    static MediaCache instance;
+    return instance;
+}
+
+MediaCache::MediaCache() : budget_(DEFAULT_CACHE_BUDGET)
+{
+    std::error_code ec;
+    dir_ = fs::temp_directory_path(ec) / "WeChatFerry" / "media";
+    if (ec) {
+        budget_ = 0;
+    }
+}
+
+std::string MediaCache::make_key(std::string_view kind, uint64_t id, const void *data, size_t len)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    fnv1a(h, data, len);
+    return std::string(kind) + ":" + std::to_string(id) + ":" + to_hex(h);
+}
+
+int MediaCache::configure(const fs::path &dir, uint64_t budget)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dir.empty() && dir != dir_) {
+        dir_    = dir;
+        loaded_ = false;
+        entries_.clear();
+        lru_.clear();
+        bytes_ = 0;
+    }
+    budget_ = budget;
+    if (budget_ > 0) {
+        load();
+        evict();
+    }
+    LOG_INFO("Media cache: {}, budget {} bytes", dir_.string(), budget_);
+    return 0;
+}
+
+void MediaCache::load()
+{
+    if (loaded_) {
+        return;
+    }
+    loaded_ = true;
+
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    std::vector<std::pair<fs::file_time_type, fs::directory_entry>> files;
+    for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto &path = it->path();
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        if (path.extension() == TEMP_SUFFIX) {
+            fs::remove(path, ec); // 上次写到一半留下的
+            continue;
+        }
+        files.emplace_back(it->last_write_time(ec), *it);
+    }
+
+    // 按修改时间从旧到新插入，最新的排在 LRU 最前
+    std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    for (const auto &[mtime, entry] : files) {
+        insert(entry.path().stem().string(), entry.path(), entry.file_size(ec));
+    }
+}
+
+void MediaCache::insert(const std::string &name, const fs::path &path, uint64_t size)
+{
+    auto it = entries_.find(name);
+    if (it != entries_.end()) {
+        bytes_ -= it->second.size;
+        lru_.erase(it->second.lru);
+        entries_.erase(it);
+    }
+    lru_.push_front(name);
+    entries_[name] = { path, size, lru_.begin() };
+    bytes_ += size;
+}
+
+void MediaCache::evict()
+{
+    while (bytes_ > budget_ && !lru_.empty()) {
+        auto it = entries_.find(lru_.back());
+        lru_.pop_back();
+        if (it == entries_.end()) {
+            continue;
+        }
+        std::error_code ec;
+        fs::remove(it->second.path, ec);
+        bytes_ -= it->second.size;
+        entries_.erase(it);
+        evictions_++;
+    }
+}
+
+std::optional<fs::path> MediaCache::lookup(const std::string &key)
+{
+    std::string name = entry_name(key);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (budget_ == 0) {
+        return std::nullopt;
+    }
+    load();
+
+    auto it = entries_.find(name);
+    if (it == entries_.end()) {
+        misses_++;
+        return std::nullopt;
+    }
+
+    // 写入都是先写临时文件再改名，大小对不上只能是被外部删掉、截断或改写了，丢掉重新解码
+    // 不校验哈希：命中后调用方还要整份复制一次，再读一遍的开销和重新解码差不多
+    std::error_code ec;
+    uint64_t size = fs::file_size(it->second.path, ec);
+    if (ec || size != it->second.size) {
+        if (!ec) {
+            LOG_WARN("Media cache entry {} size {} != {}, dropped", name, size, it->second.size);
+            fs::remove(it->second.path, ec);
+            corrupted_++;
+        }
+        bytes_ -= it->second.size;
+        lru_.erase(it->second.lru);
+        entries_.erase(it);
+        misses_++;
+        return std::nullopt;
+    }
+
+    hits_++;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    fs::last_write_time(it->second.path, fs::file_time_type::clock::now(), ec); // 重启后仍按使用时间排序
+    return it->second.path;
+}
+
+void MediaCache::store(const std::string &key, const std::string &ext, const uint8_t *data, size_t len)
+{
+    std::string name = entry_name(key);
+    fs::path path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (budget_ == 0 || len > budget_) {
+            return;
+        }
+        load();
+        path = dir_ / (name + ext);
+    }
+
+    if (!write_file_atomic(path, data, len)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (path.parent_path() != dir_) {
+        return; // 写入期间换了目录
+    }
+    insert(name, path, len);
+    stores_++;
+    evict();
+}
+
+void MediaCache::store_file(const std::string &key, const fs::path &src)
+{
+    std::error_code ec;
+    uint64_t size = fs::file_size(src, ec);
+    if (ec) {
+        return;
+    }
+
+    std::string name = entry_name(key);
+    fs::path path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (budget_ == 0 || size > budget_) {
+            return;
+        }
+        load();
+        path = dir_ / (name + src.extension().string());
+    }
+
+    if (!copy_file_atomic(src, path)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (path.parent_path() != dir_) {
+        return;
+    }
+    insert(name, path, size);
+    stores_++;
+    evict();
+}
+
+void MediaCache::collect_stats(Stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats["cache.hits"]      = hits_;
+    stats["cache.misses"]    = misses_;
+    stats["cache.stores"]    = stores_;
+    stats["cache.evictions"] = evictions_;
+    stats["cache.corrupted"] = corrupted_;
+    stats["cache.entries"]   = entries_.size();
+    stats["cache.bytes"]     = bytes_;
+    stats["cache.budget"]    = budget_;
+}
+
+bool MediaCache::rpc_configure(const CacheConfig &cc, uint8_t *out, size_t *len)
+{
+    int status = configure(cc.dir ? fs::path(cc.dir) : fs::path(), cc.budget);
+    return fill_response<Functions_FUNC_SET_MEDIA_CACHE>(out, len, [&](Response &rsp) { rsp.msg.status = status; });
+}
+
+} // namespace misc
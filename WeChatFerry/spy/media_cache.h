@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "wcf.pb.h"
+
+#include "pb_types.h"
+
+namespace misc
+{
+
+// 先写同目录的临时文件再改名，读到的要么是旧文件要么是完整的新文件
+// make_temp_path 给出与 path 同目录、不重名的临时文件，写完用 commit_temp_file 改名，失败时删掉临时文件
+std::filesystem::path make_temp_path(const std::filesystem::path &path);
+bool commit_temp_file(const std::filesystem::path &tmp, const std::filesystem::path &path);
+bool write_file_atomic(const std::filesystem::path &path, const uint8_t *data, size_t len);
+bool copy_file_atomic(const std::filesystem::path &from, const std::filesystem::path &to);
+
+// 解密后的图片、转码后的语音按内容寻址缓存，不同输出目录、不同客户端共享，同一份内容只解码一次
+// 磁盘上按 LRU 淘汰，总大小不超过预算；文件名为键的哈希加扩展名，重启后扫描目录恢复
+class MediaCache
+{
+public:
+    static MediaCache &get_instance();
+
+    // 键 = 类型:消息 id:源数据哈希
+    static std::string make_key(std::string_view kind, uint64_t id, const void *data, size_t len);
+
+    // 换目录或预算，预算为 0 关闭缓存；超出新预算的部分立即淘汰
+    int configure(const std::filesystem::path &dir, uint64_t budget);
+
+    // 命中返回缓存文件路径（带扩展名），调用方用 copy_file_atomic 取出
+    std::optional<std::filesystem::path> lookup(const std::string &key);
+    void store(const std::string &key, const std::string &ext, const uint8_t *data, size_t len);
+    void store_file(const std::string &key, const std::filesystem::path &src);
+
+    void collect_stats(Stats_t &stats);
+
+    // RPC 方法
+    bool rpc_configure(const CacheConfig &cc, uint8_t *out, size_t *len);
+
+private:
+    struct Entry {
+        std::filesystem::path path;
+        uint64_t size;
+        std::list<std::string>::iterator lru;
+    };
+
+    MediaCache();
+
+    MediaCache(const MediaCache &)            = delete;
+    MediaCache &operator=(const MediaCache &) = delete;
+
+    // 以下调用方需持有 mutex_
+    void load();
+    void insert(const std::string &name, const std::filesystem::path &path, uint64_t size);
+    void evict();
+
+    std::mutex mutex_;
+    std::filesystem::path dir_;
+    uint64_t budget_ = 0;
+    uint64_t bytes_  = 0;
+    bool loaded_     = false;
+    std::unordered_map<std::string, Entry> entries_; // 文件名（不含扩展名）-> 条目
+    std::list<std::string> lru_;                     // 最近使用的在前
+    uint64_t hits_      = 0;
+    uint64_t misses_    = 0;
+    uint64_t stores_    = 0;
+    uint64_t evictions_ = 0;
+    uint64_t corrupted_ = 0; // 命中时大小对不上被丢弃的
+};
+
+} // namespace misc
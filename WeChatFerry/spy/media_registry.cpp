@@ -0,0 +1,271 @@
+﻿#include "media_registry.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "log.hpp"
+#include "md5.h"
+#include "media_cache.h"
+#include "message_parser.h"
+#include "message_sender.h"
+
+namespace message
+{
+namespace fs = std::filesystem;
+
+#define MAX_ENTRIES   1024
+#define MAX_DIGESTS   4096
+#define MAX_PENDING   1024
+#define APP_TYPE_FILE 6
+
+static constexpr auto ECHO_TTL    = std::chrono::hours(24);  // 太旧的消息服务器上的文件可能已过期，重新发送
+static constexpr auto ECHO_WAIT   = std::chrono::minutes(2); // 大文件上传要一会儿才有回显
+static constexpr auto ECHO_SETTLE = std::chrono::seconds(5); // Hook 先于写库，刚回显时还查不到 localId
+
+static std::string image_key(const std::string &md5) { return "img:" + md5; }
+static std::string file_key(const std::string &md5, const std::string &name) { return "file:" + md5 + ":" + name; }
+
+static uint64_t micros(std::chrono::steady_clock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+MediaRegistry &MediaRegistry::get_instance()
+{
+    static MediaRegistry instance;
+    return instance;
+}
+
+MediaRegistry::MediaRegistry()
+{
+    // 回显的消息 id 不跨进程保存，上次留下的副本都作废
+    std::error_code ec;
+    dir_ = fs::temp_directory_path(ec) / "WeChatFerry" / "sent";
+    fs::remove_all(dir_, ec);
+}
+
+std::string MediaRegistry::canonicalize(Functions func, const std::string &path, std::string &key)
+{
+    key.clear();
+    if (func != Functions_FUNC_SEND_IMG && func != Functions_FUNC_SEND_FILE) {
+        return path;
+    }
+
+    std::error_code ec;
+    fs::path src  = fs::u8path(path);
+    uint64_t size = fs::file_size(src, ec);
+    if (ec || size == 0) {
+        return path;
+    }
+    auto mtime = fs::last_write_time(src, ec);
+    if (ec) {
+        return path;
+    }
+
+    std::string md5;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = digests_.find(path);
+        if (it != digests_.end() && it->second.size == size && it->second.mtime == mtime) {
+            md5 = it->second.md5;
+            digestHits_++;
+        }
+    }
+    if (md5.empty()) {
+        md5 = util::md5_file(src); // 不持锁，大文件要读一会儿
+        if (md5.empty()) {
+            return path;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (digests_.size() >= MAX_DIGESTS) {
+            digests_.clear();
+        }
+        digests_[path] = { size, mtime, md5 };
+        hashed_++;
+        hashedBytes_ += size;
+    }
+
+    std::string name = src.filename().u8string();
+    key              = func == Functions_FUNC_SEND_IMG ? image_key(md5) : file_key(md5, name);
+    fs::path dst     = dir_ / md5 / src.filename();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && fs::exists(it->second.path, ec)) {
+            it->second.used = Clock::now();
+            return it->second.path.u8string();
+        }
+    }
+
+    // 复制而不是硬链接：调用方可能原地改写源文件，副本要和 md5 对应
+    if (!fs::exists(dst, ec)) {
+        fs::create_directories(dst.parent_path(), ec);
+        if (!misc::copy_file_atomic(src, dst)) {
+            LOG_ERROR("保存发送副本失败: {}", path);
+            key.clear();
+            return path;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry &e = entries_[key];
+    e.path   = dst;
+    e.md5    = md5;
+    e.msgid  = 0; // 副本重建过，旧回显不一定还对应这份内容
+    e.used   = Clock::now();
+    evict();
+    return dst.u8string();
+}
+
+bool MediaRegistry::forward(const std::string &key, const std::string &receiver)
+{
+    if (key.empty()) {
+        return false;
+    }
+
+    uint64_t msgid;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end() || it->second.msgid == 0) {
+            return false;
+        }
+        auto now = Clock::now();
+        if (now - it->second.echoed > ECHO_TTL) {
+            it->second.msgid = 0;
+            return false;
+        }
+        if (now - it->second.echoed < ECHO_SETTLE) {
+            return false;
+        }
+        msgid           = it->second.msgid;
+        it->second.used = now;
+    }
+
+    auto start = Clock::now();
+    int status = Sender::get_instance().forward(msgid, receiver);
+    auto us    = micros(Clock::now() - start);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (status == 1) {
+        forwards_++;
+        forwardUs_ += us;
+        return true;
+    }
+
+    // 消息被删或撤回后转发失败，改为重新发送，等下一条回显
+    LOG_WARN("转发已发送的 {} 失败: {}, 改为重新发送", key, status);
+    forwardFails_++;
+    auto it = entries_.find(key);
+    if (it != entries_.end() && it->second.msgid == msgid) {
+        it->second.msgid = 0;
+    }
+    return false;
+}
+
+void MediaRegistry::sent(const std::string &key, const std::string &receiver, Clock::duration elapsed)
+{
+    if (key.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    freshSends_++;
+    freshUs_ += micros(elapsed);
+    expire(now);
+
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.msgid != 0 || pending_.size() >= MAX_PENDING) {
+        return;
+    }
+    pending_.push_back({ key, receiver, now + ECHO_WAIT });
+    waiting_ = pending_.size();
+}
+
+void MediaRegistry::observe(const WxMsg_t &msg)
+{
+    if (!msg.is_self || !is_waiting()) {
+        return;
+    }
+
+    bool image = msg.type == 0x03;
+    if (!image && (msg.type & 0xFFFF) != 0x31) {
+        return;
+    }
+    MsgFields_t f = parse_fields(msg.type, msg.content, "");
+    if (!image && f.app_type != APP_TYPE_FILE) {
+        return;
+    }
+    std::transform(f.md5.begin(), f.md5.end(), f.md5.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    expire(now);
+
+    const char *prefix = image ? "img:" : "file:";
+
+    // 同一接收人、md5 与源文件一致的第一条等待。同一时间手动发的、别的图片都可能落到这里，不核对就会转发错图
+    // 被微信压缩过的图片 md5 会变，对不上就不记，这张图一直正常发送
+    auto p = std::find_if(pending_.begin(), pending_.end(), [&](const Pending &pd) {
+        auto it = entries_.find(pd.key);
+        return pd.receiver == msg.roomid && it != entries_.end() && pd.key.rfind(prefix, 0) == 0
+            && it->second.md5 == f.md5;
+    });
+    if (p == pending_.end()) {
+        unverified_++;
+        return;
+    }
+
+    Entry &e = entries_[p->key];
+    e.msgid  = msg.id;
+    e.echoed = now;
+    echoes_++;
+    pending_.erase(p);
+    waiting_ = pending_.size();
+}
+
+void MediaRegistry::expire(Clock::time_point now)
+{
+    while (!pending_.empty() && pending_.front().deadline <= now) {
+        pending_.pop_front();
+    }
+    waiting_ = pending_.size();
+}
+
+void MediaRegistry::evict()
+{
+    std::error_code ec;
+    while (entries_.size() > MAX_ENTRIES) {
+        auto lru = std::min_element(entries_.begin(), entries_.end(),
+                                    [](const auto &a, const auto &b) { return a.second.used < b.second.used; });
+        fs::path path = lru->second.path;
+        entries_.erase(lru);
+        // 图片和文件可能共用同一个副本
+        bool shared
+            = std::any_of(entries_.begin(), entries_.end(), [&](const auto &e) { return e.second.path == path; });
+        if (!shared) {
+            fs::remove(path, ec);
+            fs::remove(path.parent_path(), ec); // 目录不空时不会删
+        }
+    }
+}
+
+void MediaRegistry::collect_stats(Stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats["sent_media.entries"]         = entries_.size();
+    stats["sent_media.waiting"]         = pending_.size();
+    stats["sent_media.hashed"]          = hashed_;
+    stats["sent_media.hashed_bytes"]    = hashedBytes_;
+    stats["sent_media.digest_hits"]     = digestHits_;
+    stats["sent_media.echoes"]          = echoes_;
+    stats["sent_media.echo_unverified"] = unverified_;
+    stats["sent_media.forwards"]        = forwards_;
+    stats["sent_media.forward_failed"]  = forwardFails_;
+    stats["sent_media.forward_us"]      = forwardUs_;
+    stats["sent_media.fresh_sends"]     = freshSends_;
+    stats["sent_media.fresh_us"]        = freshUs_;
+}
+
+} // namespace message
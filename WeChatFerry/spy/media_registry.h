@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "wcf.pb.h"
+
+#include "pb_types.h"
+
+namespace message
+{
+
+// 发送过的图片、文件按 md5 登记：同一路径不重复计算 md5，内容在暂存目录留一份固定的副本
+// 收到自己发出的消息（Hook 里 is_self 的回显）并核对内容后记下消息 id，再发相同内容时直接转发这条消息
+// 转发不用再读文件、算哈希、上传，失败或回显过期时照常发送；核对不了的回显不记，这份内容就一直正常发送
+class MediaRegistry
+{
+public:
+    static MediaRegistry &get_instance();
+
+    // 返回固定副本的路径，key 为登记用的键（图片按 md5，文件按 md5 + 文件名）
+    // 不是图片、文件，或读取失败时原样返回 path，key 为空
+    std::string canonicalize(Functions func, const std::string &path, std::string &key);
+
+    // 有可用的回显就转发，否则调用 fresh 正常发送，fresh 返回 true（已交给微信）时才等待回显
+    template <typename Fresh> bool send(const std::string &key, const std::string &receiver, Fresh &&fresh)
+    {
+        if (forward(key, receiver)) {
+            return true;
+        }
+        auto start = Clock::now();
+        if (!fresh()) {
+            return false;
+        }
+        sent(key, receiver, Clock::now() - start);
+        return true;
+    }
+
+    // Hook 据此决定要不要为自己发的消息读 content
+    bool is_waiting() const { return waiting_.load() > 0; }
+
+    // Hook 线程调用，只处理自己发的图片和文件
+    void observe(const WxMsg_t &msg);
+
+    void collect_stats(Stats_t &stats);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::filesystem::path path; // 固定副本
+        std::string md5;
+        uint64_t msgid = 0; // 回显的消息 id，0 为还没有
+        Clock::time_point echoed;
+        Clock::time_point used;
+    };
+
+    // 路径 + 大小 + 修改时间 -> md5，文件没变就不再读
+    struct Digest {
+        uint64_t size;
+        std::filesystem::file_time_type mtime;
+        std::string md5;
+    };
+
+    // 发出后等待回显，按接收人找，再核对内容
+    struct Pending {
+        std::string key;
+        std::string receiver;
+        Clock::time_point deadline;
+    };
+
+    MediaRegistry();
+
+    MediaRegistry(const MediaRegistry &)            = delete;
+    MediaRegistry &operator=(const MediaRegistry &) = delete;
+
+    bool forward(const std::string &key, const std::string &receiver);
+    void sent(const std::string &key, const std::string &receiver, Clock::duration elapsed);
+
+    // 以下调用方需持有 mutex_
+    void evict();
+    void expire(Clock::time_point now);
+
+    std::mutex mutex_;
+    std::filesystem::path dir_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::unordered_map<std::string, Digest> digests_;
+    std::deque<Pending> pending_;
+    std::atomic<size_t> waiting_ { 0 };
+    uint64_t hashed_       = 0;
+    uint64_t hashedBytes_  = 0;
+    uint64_t digestHits_   = 0;
+    uint64_t echoes_       = 0;
+    uint64_t unverified_   = 0; // 对不上内容的回显（手动发的、别的图片、微信压缩过的图片）
+    uint64_t forwards_     = 0;
+    uint64_t forwardFails_ = 0;
+    uint64_t forwardUs_    = 0;
+    uint64_t freshSends_   = 0;
+    uint64_t freshUs_      = 0;
+};
+
+} // namespace message
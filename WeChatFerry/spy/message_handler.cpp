@@ -8,9 +8,15 @@
 #include "framework.h"
 
 #include "account_manager.h"
+#include "auto_reply.h"
+#include "chatroom_manager.h"
+#include "contact_manager.h"
+#include "keyword_engine.h"
 #include "log.hpp"
+#include "media_registry.h"
 #include "offsets.h"
 #include "pb_util.h"
+#include "prefetch.h"
 #include "rpc_helper.h"
 #include "spy.h"
 #include "util.h"
@@ -25,17 +31,26 @@ namespace OsRecv = Offsets::Message::Receive;
 
 QWORD Handler::DispatchMsg(QWORD arg1, QWORD arg2)
 {
-    auto &handler = getInstance();
-    WxMsg_t wxMsg = {};
+    auto &handler    = getInstance();
+    FieldMask_t mask = handler.getMessageMask();
+    WxMsg_t wxMsg    = {};
     try {
         wxMsg.id      = util::get_qword(arg2 + OsRecv::ID);
         wxMsg.type    = util::get_dword(arg2 + OsRecv::TYPE);
         wxMsg.is_self = util::get_dword(arg2 + OsRecv::SELF);
         wxMsg.ts      = util::get_dword(arg2 + OsRecv::TIMESTAMP);
-        wxMsg.content = util::get_str_by_wstr_addr(arg2 + OsRecv::CONTENT);
-        wxMsg.sign    = util::get_str_by_wstr_addr(arg2 + OsRecv::SIGN);
-        wxMsg.xml     = util::get_str_by_wstr_addr(arg2 + OsRecv::XML);
         wxMsg.roomid  = util::get_str_by_wstr_addr(arg2 + OsRecv::ROOMID);
+        // 提取 fields 需要 content 和 xml，关键词匹配和自动回复需要 content，即使它们本身不推送
+        // 预取需要 thumb、extra 和 content（取附件大小），等待发送回显时要自己消息的 content
+        bool wantFields   = has_field(mask, WxMsg_fields_tag);
+        bool wantPrefetch = prefetch::is_active();
+        bool wantEcho     = wxMsg.is_self && MediaRegistry::get_instance().is_waiting();
+        bool wantContent  = keyword::is_active() || autoreply::is_active() || wantPrefetch || wantEcho;
+        if (wantFields || wantContent || has_field(mask, WxMsg_content_tag)) {
+            wxMsg.content = util::get_str_by_wstr_addr(arg2 + OsRecv::CONTENT);
+        }
+        if (has_field(mask, WxMsg_sign_tag)) wxMsg.sign = util::get_str_by_wstr_addr(arg2 + OsRecv::SIGN);
+        if (wantFields || has_field(mask, WxMsg_xml_tag)) wxMsg.xml = util::get_str_by_wstr_addr(arg2 + OsRecv::XML);
 
         if (wxMsg.roomid.find("@chatroom") != std::string::npos) { // 群 ID 的格式为 xxxxxxxxxxx@chatroom
             wxMsg.is_group = true;
@@ -45,16 +60,28 @@ QWORD Handler::DispatchMsg(QWORD arg1, QWORD arg2)
             wxMsg.sender   = wxMsg.is_self ? account::get_self_wxid() : wxMsg.roomid;
         }
 
-        fs::path thumb = util::get_str_by_wstr_addr(arg2 + OsRecv::THUMB);
+        bool wantThumb = wantPrefetch || has_field(mask, WxMsg_thumb_tag);
+        bool wantExtra = wantPrefetch || has_field(mask, WxMsg_extra_tag);
+        fs::path thumb = wantThumb ? util::get_str_by_wstr_addr(arg2 + OsRecv::THUMB) : "";
         if (!thumb.empty()) {
             wxMsg.thumb = (account::get_home_path() / thumb).generic_string();
         }
 
-        fs::path extra = util::get_str_by_wstr_addr(arg2 + OsRecv::EXTRA);
+        fs::path extra = wantExtra ? util::get_str_by_wstr_addr(arg2 + OsRecv::EXTRA) : "";
         if (!extra.empty()) {
             wxMsg.extra = (account::get_home_path() / extra).generic_string();
         }
+        // 群系统消息可能是成员变动，让群成员缓存失效
+        if (wxMsg.is_group) {
+            chatroom::on_room_message(wxMsg.roomid, wxMsg.type == 0x2710 || wxMsg.type == 0x2712);
+        }
         LOG_DEBUG("{}", wxMsg.content);
+        // 自动回复和预取在独立线程执行，不经过推送队列和客户端
+        autoreply::post(wxMsg);
+        prefetch::post(wxMsg);
+        if (wantEcho) {
+            MediaRegistry::get_instance().observe(wxMsg);
+        }
     } catch (const std::exception &e) {
         LOG_ERROR(util::gb2312_to_utf8(e.what()));
     }
@@ -158,6 +185,11 @@ MsgTypes_t Handler::GetMsgTypes()
              { 0x270F, "SYSNOTICE" },
              { 0x2710, "红包、系统消息" },
              { 0x2712, "撤回消息" },
+             { 0x10000, "群成员变动" },
+             { 0x10001, "异步发送结果" },
+             { 0x10002, "批量解密进度" },
+             { 0x10003, "批量语音结果" },
+             { 0x10004, "附件下载结果" },
              { 0x100031, "搜狗表情" },
              { 0x1000031, "链接" },
              { 0x1A000031, "微信红包" },
@@ -173,6 +205,45 @@ MsgTypes_t Handler::GetMsgTypes()
              { 0x41000031, "文件" } };
 }
 
+void Handler::pushMessage(WxMsg_t msg)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        msgQueue_.push(std::move(msg));
+    }
+    cv_.notify_all();
+}
+
+void Handler::EnrichMsg(WxMsg_t &msg)
+{
+    if (msg.sender.empty() || is_notice(msg)) {
+        return;
+    }
+
+    nameLookups_++;
+    if (contact::find_contact_name(msg.sender, msg.sender_name)) {
+        nameHits_++;
+    }
+
+    if (msg.is_group) {
+        aliasLookups_++;
+        if (chatroom::find_member_alias(msg.roomid, msg.sender, msg.room_alias)) {
+            aliasHits_++;
+        }
+    }
+}
+
+void Handler::CollectStats(Stats_t &stats) const
+{
+    stats["enrich.name_lookups"]  = nameLookups_.load();
+    stats["enrich.name_hits"]     = nameHits_.load();
+    stats["enrich.alias_lookups"] = aliasLookups_.load();
+    stats["enrich.alias_hits"]    = aliasHits_.load();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats["msg.queued"] = msgQueue_.size();
+}
+
 std::optional<WxMsg_t> Handler::popMessage()
 {
     std::lock_guard<std::mutex> lock(mutex_);
@@ -278,4 +349,10 @@ bool Handler::rpc_get_msg_types(uint8_t *out, size_t *len)
         rsp.msg.types.types.arg          = &types;
     });
 }
+
+bool Handler::rpc_enable_enrich(bool enable, uint8_t *out, size_t *len)
+{
+    setEnrich(enable);
+    return fill_response<Functions_FUNC_ENABLE_MSG_ENRICH>(out, len, [&](Response &rsp) { rsp.msg.status = 0; });
+}
 }
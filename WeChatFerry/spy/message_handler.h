@@ -33,11 +33,24 @@ public:
     bool isMessageListening() const { return isListeningMsg.load(); }
     bool isPyqListening() const { return isListeningPyq.load(); }
 
+    // 消息推送的字段掩码（WxMsg），未请求的字段不读取也不编码
+    void setMessageMask(FieldMask_t mask) { msgMask_ = mask; }
+    FieldMask_t getMessageMask() const { return msgMask_.load(); }
+
+    // 消息补充发送者昵称、群昵称，数据只来自内存缓存
+    void setEnrich(bool enable) { enrich_ = enable; }
+    bool isEnrichEnabled() const { return enrich_.load(); }
+    void EnrichMsg(WxMsg_t &msg);
+    void CollectStats(Stats_t &stats) const;
+
+    // 推送一条消息到队列，供 Hook 以外的来源（如群成员变动事件）使用
+    void pushMessage(WxMsg_t msg);
     std::optional<WxMsg_t> popMessage();
     std::condition_variable &getConditionVariable() { return cv_; };
     std::mutex &getMutex() { return mutex_; };
 
     bool rpc_get_msg_types(uint8_t *out, size_t *len);
+    bool rpc_enable_enrich(bool enable, uint8_t *out, size_t *len);
 
 private:
     Handler();
@@ -50,6 +63,12 @@ private:
     std::atomic<bool> isLogging { false };
     std::atomic<bool> isListeningMsg { false };
     std::atomic<bool> isListeningPyq { false };
+    std::atomic<FieldMask_t> msgMask_ { 0 };
+    std::atomic<bool> enrich_ { false };
+    std::atomic<uint64_t> nameLookups_ { 0 };
+    std::atomic<uint64_t> nameHits_ { 0 };
+    std::atomic<uint64_t> aliasLookups_ { 0 };
+    std::atomic<uint64_t> aliasHits_ { 0 };
 
     using funcRecvMsg_t = QWORD (*)(QWORD, QWORD);
     using funcWxLog_t   = QWORD (*)(QWORD, QWORD, QWORD, QWORD, QWORD, QWORD, QWORD, QWORD, QWORD, QWORD, QWORD, QWORD);
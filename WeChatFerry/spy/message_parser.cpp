@@ -0,0 +1,146 @@
+﻿#include "message_parser.h"
+
+#include <string_view>
+
+#include "xml_scanner.h"
+
+namespace message
+{
+
+using util::XmlScanner;
+
+#define MAX_DEPTH 16
+
+static uint64_t parse_uint(std::string_view s)
+{
+    uint64_t v = 0;
+    size_t i   = 0;
+    while (i < s.size() && (s[i] == ' ' || s[i] == '\n' || s[i] == '\r' || s[i] == '\t')) i++;
+    for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; i++) {
+        v = v * 10 + (s[i] - '0');
+    }
+    return v;
+}
+
+// 只保存标签名的视图，不拷贝
+class TagPath
+{
+public:
+    void push(std::string_view name)
+    {
+        if (depth_ < MAX_DEPTH) tags_[depth_] = name;
+        depth_++;
+    }
+    void pop()
+    {
+        if (depth_ > 0) depth_--;
+    }
+    // 从栈顶往下第 n 层的标签名，0 为当前标签
+    std::string_view at(size_t n) const
+    {
+        return (n < depth_ && depth_ - 1 - n < MAX_DEPTH) ? tags_[depth_ - 1 - n] : std::string_view();
+    }
+
+private:
+    std::string_view tags_[MAX_DEPTH];
+    size_t depth_ = 0;
+};
+
+// 图片、视频的 md5、大小、尺寸都在标签属性里
+static void parse_media_attrs(const XmlScanner &xs, MsgFields_t &f)
+{
+    std::string_view v;
+    if (xs.attr("md5", v)) f.md5 = std::string(v);
+    if (xs.attr("length", v)) f.size = parse_uint(v);
+
+    // 优先高清图尺寸，没有时依次退到中图、缩略图
+    for (auto [w, h] : { std::pair { "cdnhdwidth", "cdnhdheight" }, std::pair { "cdnmidwidth", "cdnmidheight" },
+                         std::pair { "cdnthumbwidth", "cdnthumbheight" } }) {
+        std::string_view vw, vh;
+        if (xs.attr(w, vw) && xs.attr(h, vh) && parse_uint(vw) > 0) {
+            f.width  = static_cast<uint32_t>(parse_uint(vw));
+            f.height = static_cast<uint32_t>(parse_uint(vh));
+            break;
+        }
+    }
+}
+
+static void split_at_users(const std::string &list, MsgFields_t &f)
+{
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        if (end > start) f.at_users.emplace_back(list, start, end - start);
+        start = end + 1;
+    }
+}
+
+static void scan(std::string_view src, MsgFields_t &f)
+{
+    XmlScanner xs(src);
+    TagPath path;
+    for (auto tok = xs.next(); tok != XmlScanner::Token::End; tok = xs.next()) {
+        switch (tok) {
+            case XmlScanner::Token::StartTag:
+                path.push(xs.name());
+                if ((xs.name() == "img" || xs.name() == "videomsg") && path.at(1) == "msg") {
+                    parse_media_attrs(xs, f);
+                }
+                break;
+
+            case XmlScanner::Token::EndTag:
+                path.pop();
+                break;
+
+            case XmlScanner::Token::Text: {
+                std::string_view tag = path.at(0), parent = path.at(1);
+                if (tag == "atuserlist") {
+                    split_at_users(xs.text_value(), f);
+                } else if (parent == "refermsg") {
+                    if (tag == "svrid") f.quoted_id = parse_uint(xs.text());
+                } else if (parent == "appmsg") {
+                    if (tag == "type" && f.app_type == 0) {
+                        f.app_type = static_cast<uint32_t>(parse_uint(xs.text()));
+                    } else if (tag == "title" && f.title.empty()) {
+                        f.title = xs.text_value();
+                    } else if (tag == "url" && f.url.empty()) {
+                        f.url = xs.text_value();
+                    } else if (tag == "md5" && f.md5.empty()) {
+                        f.md5 = xs.text_value();
+                    }
+                } else if (parent == "appattach") {
+                    if (tag == "totallen") {
+                        f.size = parse_uint(xs.text());
+                    } else if (tag == "md5" && f.md5.empty()) {
+                        f.md5 = xs.text_value();
+                    }
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+}
+
+MsgFields_t parse_fields(uint32_t type, const std::string &content, const std::string &xml)
+{
+    MsgFields_t f = {};
+    if (!xml.empty()) {
+        scan(xml, f); // msgsource，主要是 atuserlist
+    }
+
+    // 图片、视频、小视频、appmsg（低 16 位为 0x31）的 content 是 xml
+    bool xmlContent = (type == 0x03 || type == 0x2B || type == 0x3E || (type & 0xFFFF) == 0x31);
+    if (xmlContent && !content.empty()) {
+        size_t start = content.find('<');
+        if (start != std::string::npos) {
+            scan(std::string_view(content).substr(start), f);
+        }
+    }
+    return f;
+}
+
+} // namespace message
@@ -0,0 +1,13 @@
+﻿#pragma once
+
+#include <string>
+
+#include "pb_types.h"
+
+namespace message
+{
+
+// 单次扫描 content 和 xml，提取 @ 列表、引用消息、appmsg、文件和图片信息
+MsgFields_t parse_fields(uint32_t type, const std::string &content, const std::string &xml);
+
+} // namespace message
@@ -1,15 +1,19 @@
 ﻿#include "message_sender.h"
 
+#include <chrono>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #include "account_manager.h"
 #include "database_executor.h"
 #include "log.hpp"
+#include "media_registry.h"
 #include "offsets.h"
 #include "rpc_helper.h"
 #include "spy.h"
 #include "spy_types.h"
+#include "upload_store.h"
 #include "util.h"
 
 namespace message
@@ -17,6 +21,19 @@ namespace message
 
 namespace OsSend = Offsets::Message::Send;
 
+// 批量操作在 RPC 线程上同步执行，间隔的总和不超过这个值，更长的节奏请用异步队列
+#define MAX_PACING_MS 1000
+
+static uint32_t cap_interval(size_t count, uint32_t interval_ms)
+{
+    if (count < 2 || interval_ms <= MAX_PACING_MS / (count - 1)) {
+        return interval_ms;
+    }
+    uint32_t capped = static_cast<uint32_t>(MAX_PACING_MS / (count - 1));
+    LOG_WARN("间隔 {}ms x {} 超过 {}ms，改为 {}ms", interval_ms, count - 1, MAX_PACING_MS, capped);
+    return capped;
+}
+
 Sender &Sender::get_instance()
 {
     static Sender instance;
@@ -51,9 +68,23 @@ void Sender::send_text(const std::string &wxid, const std::string &msg, const st
     auto wxAtWxids   = util::parse_wxids(at_wxids).wxWxids;
     QWORD pWxAtWxids = wxAtWxids.empty() ? 0 : reinterpret_cast<QWORD>(&wxAtWxids);
 
+    send_text(&holderWxid.wx, &holderMsg.wx, pWxAtWxids);
+}
+
+void Sender::send_text(const std::string &wxid, const std::wstring &msg)
+{
+    WxString wxMsg(msg);
+    util::WxStringHolder<std::string> holderWxid(wxid);
+
+    send_text(&holderWxid.wx, &wxMsg, 0);
+}
+
+void Sender::send_text(WxString *wxid, WxString *msg, QWORD atWxids)
+{
     char buffer[1104] = { 0 };
+    std::lock_guard<std::mutex> lock(send_mutex);
     func_send_msg_mgr();
-    func_send_text(reinterpret_cast<QWORD>(&buffer), &holderWxid.wx, &holderMsg.wx, pWxAtWxids, 1, 1, 0, 0);
+    func_send_text(reinterpret_cast<QWORD>(&buffer), wxid, msg, atWxids, 1, 1, 0, 0);
     func_free_chat_msg(reinterpret_cast<QWORD>(&buffer));
 }
 
@@ -62,11 +93,17 @@ void Sender::send_image(const std::string &wxid, const std::string &path)
     util::WxStringHolder<std::string> holderWxid(wxid);
     util::WxStringHolder<std::string> holderPath(path);
 
+    send_image(&holderWxid.wx, &holderPath.wx);
+}
+
+void Sender::send_image(WxString *wxid, WxString *path)
+{
     char msg[1192]    = { 0 };
     char msgTmp[1192] = { 0 };
     QWORD *flag[10]   = { 0 };
 
     QWORD tmp1 = 1, tmp2 = 0, tmp3 = 0;
+    std::lock_guard<std::mutex> lock(send_mutex);
     QWORD pMsgTmp = func_new_chat_msg((QWORD)(&msgTmp));
     flag[0]       = reinterpret_cast<QWORD *>(tmp1);
     flag[1]       = reinterpret_cast<QWORD *>(pMsgTmp);
@@ -75,27 +112,27 @@ void Sender::send_image(const std::string &wxid, const std::string &path)
 
     QWORD pMsg    = func_new_chat_msg((QWORD)(&msg));
     QWORD sendMgr = func_send_msg_mgr();
-    func_send_image(sendMgr, pMsg, &holderWxid.wx, &holderPath.wx, reinterpret_cast<QWORD>(&flag));
+    func_send_image(sendMgr, pMsg, wxid, path, reinterpret_cast<QWORD>(&flag));
 
     func_free_chat_msg(pMsg);
     func_free_chat_msg(pMsgTmp);
 }
 
-void Sender::send_file(const std::string &wxid, const std::string &path)
+bool Sender::send_file(const std::string &wxid, const std::string &path)
 {
     WxString *wxWxid = util::CreateWxString(wxid);
     WxString *wxPath = util::CreateWxString(path);
     if (!wxWxid || !wxPath) {
         util::FreeWxString(wxWxid);
         util::FreeWxString(wxPath);
-        return;
+        return false;
     }
 
     char *chat_msg = reinterpret_cast<char *>(util::AllocFromHeap(0x460));
     if (!chat_msg) {
         util::FreeWxString(wxWxid);
         util::FreeWxString(wxPath);
-        return;
+        return false;
     }
 
     QWORD *tmp1 = util::AllocBuffer<QWORD>(4);
@@ -109,12 +146,15 @@ void Sender::send_file(const std::string &wxid, const std::string &path)
         util::FreeBuffer(tmp3);
         util::FreeWxString(wxWxid);
         util::FreeWxString(wxPath);
-        return;
+        return false;
     }
 
-    QWORD app_mgr = func_get_app_mgr();
-    func_send_file(app_mgr, chat_msg, wxWxid, wxPath, 1, tmp1, 0, tmp2, 0, tmp3, 0, 0xC);
-    func_free_chat_msg(reinterpret_cast<QWORD>(chat_msg));
+    {
+        std::lock_guard<std::mutex> lock(send_mutex);
+        QWORD app_mgr = func_get_app_mgr();
+        func_send_file(app_mgr, chat_msg, wxWxid, wxPath, 1, tmp1, 0, tmp2, 0, tmp3, 0, 0xC);
+        func_free_chat_msg(reinterpret_cast<QWORD>(chat_msg));
+    }
 
     util::FreeBuffer(chat_msg);
     util::FreeBuffer(tmp1);
@@ -122,6 +162,7 @@ void Sender::send_file(const std::string &wxid, const std::string &path)
     util::FreeBuffer(tmp3);
     util::FreeWxString(wxWxid);
     util::FreeWxString(wxPath);
+    return true;
 }
 
 void Sender::send_xml(const std::string &receiver, const std::string &xml, const std::string &path, uint64_t type)
@@ -164,8 +205,11 @@ void Sender::send_emotion(const std::string &wxid, const std::string &path)
         return;
     }
 
-    QWORD mgr = func_get_emotion_mgr();
-    func_send_emotion(mgr, wxPath, buff, wxWxid, 2, buff, 0, buff);
+    {
+        std::lock_guard<std::mutex> lock(send_mutex);
+        QWORD mgr = func_get_emotion_mgr();
+        func_send_emotion(mgr, wxPath, buff, wxWxid, 2, buff, 0, buff);
+    }
     util::FreeBuffer(buff);
     util::FreeWxString(wxWxid);
     util::FreeWxString(wxPath);
@@ -196,16 +240,19 @@ int Sender::send_rich_text(const RichText &rt)
         return static_cast<int>(status);
     }
 
-    func_new_mmreader(reinterpret_cast<QWORD>(buff));
-    memcpy(buff + 0x8, pTitle, sizeof(WxString));
-    memcpy(buff + 0x48, pUrl, sizeof(WxString));
-    memcpy(buff + 0xB0, pThumburl, sizeof(WxString));
-    memcpy(buff + 0xF0, pDigest, sizeof(WxString));
-    memcpy(buff + 0x2C0, pAccount, sizeof(WxString));
-    memcpy(buff + 0x2E0, pName, sizeof(WxString));
-
-    status = func_send_rich_text(func_get_app_mgr(), pReceiver, buff);
-    func_free_mmreader(reinterpret_cast<QWORD>(buff));
+    {
+        std::lock_guard<std::mutex> lock(send_mutex);
+        func_new_mmreader(reinterpret_cast<QWORD>(buff));
+        memcpy(buff + 0x8, pTitle, sizeof(WxString));
+        memcpy(buff + 0x48, pUrl, sizeof(WxString));
+        memcpy(buff + 0xB0, pThumburl, sizeof(WxString));
+        memcpy(buff + 0xF0, pDigest, sizeof(WxString));
+        memcpy(buff + 0x2C0, pAccount, sizeof(WxString));
+        memcpy(buff + 0x2E0, pName, sizeof(WxString));
+
+        status = func_send_rich_text(func_get_app_mgr(), pReceiver, buff);
+        func_free_mmreader(reinterpret_cast<QWORD>(buff));
+    }
 
     // TODO: 验证是否有内存泄露
     // util::FreeWxString(pReceiver);
@@ -227,28 +274,68 @@ int Sender::send_pat(const std::string &roomid, const std::string &wxid)
     util::WxStringHolder<std::string> holderRoom(roomid);
     util::WxStringHolder<std::string> holderWxid(wxid);
 
+    std::lock_guard<std::mutex> lock(send_mutex);
     status = func_send_pat(&holderRoom.wx, &holderWxid.wx);
 
     return static_cast<int>(status);
 }
 
+std::vector<int> Sender::send_pat(const std::string &roomid, const std::vector<std::string> &wxids,
+                                  uint32_t interval_ms)
+{
+    std::vector<int> statuses;
+    interval_ms = cap_interval(wxids.size(), interval_ms);
+    util::WxStringHolder<std::string> holderRoom(roomid);
+    for (size_t i = 0; i < wxids.size(); i++) {
+        if (i > 0 && interval_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+        }
+        if (wxids[i].empty()) {
+            statuses.push_back(-1);
+            continue;
+        }
+        util::WxStringHolder<std::string> holderWxid(wxids[i]);
+        std::lock_guard<std::mutex> lock(send_mutex); // 只锁单次调用，间隔期间别的线程可以发送
+        statuses.push_back(static_cast<int>(func_send_pat(&holderRoom.wx, &holderWxid.wx)));
+    }
+    return statuses;
+}
+
 int Sender::forward(QWORD msgid, const std::string &receiver)
+{
+    return forward(msgid, std::vector<std::string> { receiver }, 0).front();
+}
+
+std::vector<int> Sender::forward(QWORD msgid, const std::vector<std::string> &receivers, uint32_t interval_ms)
 {
     uint32_t dbIdx = 0;
     QWORD localId  = 0;
 
+    // 查 localId 要扫多个分库，多个接收人只查一次
     if (db::get_local_id_and_dbidx(msgid, &localId, &dbIdx) != 0) {
         LOG_ERROR("Failed to get localId, Please check id: {}", msgid);
-        return -1;
+        return std::vector<int>(receivers.size(), -1);
     }
 
     LARGE_INTEGER l;
     l.HighPart = dbIdx;
     l.LowPart  = static_cast<DWORD>(localId);
 
-    WxString *pReceiver = util::CreateWxString(receiver);
-
-    return static_cast<int>(func_forward(pReceiver, l.QuadPart, 0x4, 0x0));
+    std::vector<int> statuses;
+    interval_ms = cap_interval(receivers.size(), interval_ms);
+    for (size_t i = 0; i < receivers.size(); i++) {
+        if (i > 0 && interval_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+        }
+        if (receivers[i].empty()) {
+            statuses.push_back(-1);
+            continue;
+        }
+        WxString *pReceiver = util::CreateWxString(receivers[i]);
+        std::lock_guard<std::mutex> lock(send_mutex);
+        statuses.push_back(static_cast<int>(func_forward(pReceiver, l.QuadPart, 0x4, 0x0)));
+    }
+    return statuses;
 }
 
 // RPC 方法
@@ -267,14 +354,20 @@ bool Sender::rpc_send_text(const TextMsg &text, uint8_t *out, size_t *len)
 
 bool Sender::rpc_send_image(const PathMsg &file, uint8_t *out, size_t *len)
 {
-    std::string path(file.path);
+    std::string path = UploadStore::get_instance().resolve(file.path);
     std::string receiver(file.receiver);
     return fill_response<Functions_FUNC_SEND_IMG>(out, len, [&](Response &rsp) {
         if (path.empty() || receiver.empty()) {
             LOG_ERROR("Empty path or receiver.");
             rsp.msg.status = -1;
         } else {
-            send_image(receiver, path);
+            std::string key;
+            auto &registry    = MediaRegistry::get_instance();
+            std::string media = registry.canonicalize(Functions_FUNC_SEND_IMG, path, key);
+            registry.send(key, receiver, [&] {
+                send_image(receiver, media);
+                return true;
+            });
             rsp.msg.status = 0;
         }
     });
@@ -282,22 +375,25 @@ bool Sender::rpc_send_image(const PathMsg &file, uint8_t *out, size_t *len)
 
 bool Sender::rpc_send_file(const PathMsg &file, uint8_t *out, size_t *len)
 {
-    std::string path(file.path);
+    std::string path = UploadStore::get_instance().resolve(file.path);
     std::string receiver(file.receiver);
     return fill_response<Functions_FUNC_SEND_FILE>(out, len, [&](Response &rsp) {
         if (path.empty() || receiver.empty()) {
             LOG_ERROR("Empty path or receiver.");
             rsp.msg.status = -1;
         } else {
-            send_file(receiver, path);
-            rsp.msg.status = 0;
+            std::string key;
+            auto &registry    = MediaRegistry::get_instance();
+            std::string media = registry.canonicalize(Functions_FUNC_SEND_FILE, path, key);
+            bool ok           = registry.send(key, receiver, [&] { return send_file(receiver, media); });
+            rsp.msg.status    = ok ? 0 : -1;
         }
     });
 }
 
 bool Sender::rpc_send_emotion(const PathMsg &file, uint8_t *out, size_t *len)
 {
-    std::string path(file.path);
+    std::string path = UploadStore::get_instance().resolve(file.path);
     std::string receiver(file.receiver);
     return fill_response<Functions_FUNC_SEND_EMOTION>(out, len, [&](Response &rsp) {
         if (path.empty() || receiver.empty()) {
@@ -363,4 +459,39 @@ bool Sender::rpc_forward(const ForwardMsg &fm, uint8_t *out, size_t *len)
     });
 }
 
+bool Sender::rpc_forward_many(const MultiForward &mf, uint8_t *out, size_t *len)
+{
+    std::vector<std::string> receivers;
+    for (pb_size_t i = 0; i < mf.receivers_count; i++) {
+        receivers.emplace_back(mf.receivers[i] ? mf.receivers[i] : "");
+    }
+
+    std::vector<int> statuses = forward(mf.id, receivers, mf.interval_ms);
+    return fill_response<Functions_FUNC_FORWARD_MSGS>(out, len, [&](Response &rsp) {
+        rsp.msg.statuses.values_count = static_cast<pb_size_t>(statuses.size());
+        rsp.msg.statuses.values       = statuses.data();
+    });
+}
+
+bool Sender::rpc_send_pats(const MultiPat &mp, uint8_t *out, size_t *len)
+{
+    std::string roomid(mp.roomid ? mp.roomid : "");
+    std::vector<std::string> wxids;
+    for (pb_size_t i = 0; i < mp.wxids_count; i++) {
+        wxids.emplace_back(mp.wxids[i] ? mp.wxids[i] : "");
+    }
+
+    std::vector<int> statuses;
+    if (roomid.empty()) {
+        LOG_ERROR("Empty roomid.");
+        statuses.assign(wxids.size(), -1);
+    } else {
+        statuses = send_pat(roomid, wxids, mp.interval_ms);
+    }
+    return fill_response<Functions_FUNC_SEND_PATS>(out, len, [&](Response &rsp) {
+        rsp.msg.statuses.values_count = static_cast<pb_size_t>(statuses.size());
+        rsp.msg.statuses.values       = statuses.data();
+    });
+}
+
 }
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -18,12 +19,18 @@ public:
 
     void send_text(const std::string &wxid, const std::string &msg, const std::string &at_wxids = "");
     void send_image(const std::string &wxid, const std::string &path);
-    void send_file(const std::string &wxid, const std::string &path);
+    // 内容已转成宽字符，群发时同一内容只转换一次
+    void send_text(const std::string &wxid, const std::wstring &msg);
+    // 参数或内存分配失败时返回 false，微信那边是否发出要看回显
+    bool send_file(const std::string &wxid, const std::string &path);
     void send_xml(const std::string &receiver, const std::string &xml, const std::string &path, uint64_t type);
     void send_emotion(const std::string &wxid, const std::string &path);
     int send_rich_text(const RichText &rt);
     int send_pat(const std::string &roomid, const std::string &wxid);
     int forward(uint64_t msgid, const std::string &receiver);
+    // 批量操作，返回与输入一一对应的状态；interval_ms 为相邻两次调用的间隔，总和上限 1 秒
+    std::vector<int> send_pat(const std::string &roomid, const std::vector<std::string> &wxids, uint32_t interval_ms);
+    std::vector<int> forward(uint64_t msgid, const std::vector<std::string> &receivers, uint32_t interval_ms);
 
     // RPC 方法
     bool rpc_send_text(const TextMsg &text, uint8_t *out, size_t *len);
@@ -34,6 +41,8 @@ public:
     bool rpc_send_rich_text(const RichText &rt, uint8_t *out, size_t *len);
     bool rpc_send_pat(const PatMsg &pat, uint8_t *out, size_t *len);
     bool rpc_forward(const ForwardMsg &fm, uint8_t *out, size_t *len);
+    bool rpc_forward_many(const MultiForward &mf, uint8_t *out, size_t *len);
+    bool rpc_send_pats(const MultiPat &mp, uint8_t *out, size_t *len);
 
 private:
     Sender();
@@ -75,6 +84,12 @@ private:
     XmlBufSign_t func_xml_buf_sign;
     SendXml_t func_send_xml;
 
+    // 异步发送队列、自动回复和 RPC 线程都会发送，微信的发送函数逐个调用，不并发进入
+    std::mutex send_mutex;
+
+    void send_text(WxString *wxid, WxString *msg, QWORD atWxids);
+    void send_image(WxString *wxid, WxString *path);
+
     std::unique_ptr<WxString> new_wx_string(const char *str);
     std::unique_ptr<WxString> new_wx_string(const std::string &str);
 };
@@ -1,20 +1,31 @@
 ﻿#pragma warning(disable : 4244)
 #include "misc_manager.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "framework.h"
 
 #include "codec.h"
 #include "database_executor.h"
 #include "log.hpp"
+#include "media_cache.h"
 #include "message_handler.h"
 #include "offsets.h"
+#include "pb_util.h"
 #include "rpc_helper.h"
 #include "spy.h"
 #include "spy_types.h"
 #include "util.h"
+#include "xor_cipher.h"
 
 namespace misc
 {
@@ -62,7 +73,17 @@ static std::string detect_image_extension(uint8_t header1, uint8_t header2, uint
     return "";
 }
 
-std::string decrypt_image(const fs::path &src, const fs::path &dst_dir)
+static constexpr size_t DECRYPT_CHUNK_SIZE  = 1 << 20;
+static constexpr size_t MAX_DECRYPT_WORKERS = 16;
+static constexpr size_t MAX_DECRYPT_ERRORS  = 100;
+static constexpr size_t MAX_DECRYPT_BATCHES = 4;  // 同时运行的批次
+static constexpr size_t MAX_DECRYPT_RESULTS = 16; // 保留结果的已结束批次
+static constexpr auto DECRYPT_PROGRESS_INTERVAL = std::chrono::milliseconds(500);
+static constexpr size_t DEFAULT_IMAGE_CHUNK_SIZE = 4 << 20;
+static constexpr size_t MAX_IMAGE_CHUNK_SIZE     = 8 << 20; // 响应缓冲区为 16 MB
+
+// 不经过缓存直接解密，批量解密也用这个，免得把缓存冲掉
+static std::string decrypt_file(const fs::path &src, const fs::path &dst_dir)
 {
     if (!fs::exists(src)) {
         LOG_ERROR("文件不存在: {}", src.string());
@@ -75,8 +96,11 @@ std::string decrypt_image(const fs::path &src, const fs::path &dst_dir)
         return "";
     }
 
-    std::vector<char> buffer(std::istreambuf_iterator<char>(in), {});
-    if (buffer.size() < 2) return "";
+    // 按块读、原地异或、整块写，内存只占一个块
+    std::vector<char> buffer(DECRYPT_CHUNK_SIZE);
+    in.read(buffer.data(), buffer.size());
+    size_t n = static_cast<size_t>(in.gcount());
+    if (n < 2) return "";
 
     uint8_t key = 0x00;
     auto ext    = detect_image_extension(buffer[0], buffer[1], &key);
@@ -85,19 +109,365 @@ std::string decrypt_image(const fs::path &src, const fs::path &dst_dir)
         return "";
     }
 
-    std::for_each(buffer.begin(), buffer.end(), [key](char &c) { c ^= key; });
-
     fs::path dst_path = dst_dir / (src.stem().string() + ext);
     if (!fs::exists(dst_dir)) fs::create_directories(dst_dir);
 
-    std::ofstream out(dst_path, std::ios::binary);
+    fs::path tmp_path = make_temp_path(dst_path);
+    std::ofstream out(tmp_path, std::ios::binary);
     if (!out) {
-        LOG_ERROR("写入文件失败: {}", dst_path.generic_string());
+        LOG_ERROR("写入文件失败: {}", tmp_path.generic_string());
+        return "";
+    }
+
+    while (n > 0 && out) {
+        util::xor_inplace(reinterpret_cast<uint8_t *>(buffer.data()), n, key);
+        out.write(buffer.data(), n);
+        in.read(buffer.data(), buffer.size());
+        n = static_cast<size_t>(in.gcount());
+    }
+
+    out.close();
+    if (!out || in.bad()) {
+        LOG_ERROR("写入文件失败: {}", tmp_path.generic_string());
+        std::error_code ec;
+        fs::remove(tmp_path, ec); // 不留半截文件
         return "";
     }
+    return commit_temp_file(tmp_path, dst_path) ? dst_path.generic_string() : "";
+}
+
+// 图片以源文件的路径、大小和修改时间为键，不用为了算哈希把整个文件读一遍
+static std::string image_cache_key(const fs::path &src)
+{
+    std::error_code ec;
+    auto size = fs::file_size(src, ec);
+    if (ec) return "";
+    auto mtime = fs::last_write_time(src, ec);
+    if (ec) return "";
+
+    std::string id = fs::absolute(src, ec).generic_string();
+    id.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    auto ticks = mtime.time_since_epoch().count();
+    id.append(reinterpret_cast<const char *>(&ticks), sizeof(ticks));
+    return MediaCache::make_key("img", 0, id.data(), id.size());
+}
+
+std::string decrypt_image(const fs::path &src, const fs::path &dst_dir)
+{
+    auto &cache     = MediaCache::get_instance();
+    std::string key = image_cache_key(src);
+    if (!key.empty()) {
+        if (auto hit = cache.lookup(key)) {
+            fs::path dst_path = dst_dir / (src.stem().string() + hit->extension().string());
+            std::error_code ec;
+            fs::create_directories(dst_dir, ec);
+            if (copy_file_atomic(*hit, dst_path)) {
+                return dst_path.generic_string();
+            }
+        }
+    }
+
+    std::string out = decrypt_file(src, dst_dir);
+    if (!out.empty() && !key.empty()) {
+        cache.store_file(key, out);
+    }
+    return out;
+}
+
+ImageData_t read_image(const fs::path &src, uint64_t offset, size_t size)
+{
+    std::ifstream in(src, std::ios::binary);
+    if (!in) {
+        LOG_ERROR("无法打开文件: {}", src.string());
+        return {};
+    }
+
+    std::error_code ec;
+    uint64_t total = fs::file_size(src, ec);
+    char header[2] = { 0 };
+    if (ec || !in.read(header, sizeof(header))) {
+        LOG_ERROR("读取文件失败: {}", src.string());
+        return {};
+    }
+
+    uint8_t key = 0x00;
+    auto ext    = detect_image_extension(header[0], header[1], &key);
+    if (ext.empty()) {
+        LOG_ERROR("无法检测文件类型.");
+        return {};
+    }
+
+    ImageData_t img = {};
+    img.format      = ext.substr(1);
+    img.total       = total;
+    img.offset      = std::min(offset, total);
+
+    size = size ? std::min(size, MAX_IMAGE_CHUNK_SIZE) : DEFAULT_IMAGE_CHUNK_SIZE;
+    img.data.resize(static_cast<size_t>(std::min<uint64_t>(size, total - img.offset)));
+    in.seekg(static_cast<std::streamoff>(img.offset));
+    in.read(reinterpret_cast<char *>(img.data.data()), img.data.size());
+    img.data.resize(static_cast<size_t>(in.gcount()));
+    util::xor_inplace(img.data.data(), img.data.size(), key);
+    return img;
+}
+
+// 目标目录里已有同名、大小一致且不旧于源文件的解密结果（异或不改变大小）
+static bool is_decrypted(const fs::path &src, const fs::path &dst_dir)
+{
+    std::error_code ec;
+    auto size = fs::file_size(src, ec);
+    if (ec) return false;
+    auto mtime = fs::last_write_time(src, ec);
+    if (ec) return false;
+
+    for (const auto &pat : patterns) {
+        fs::path dst = dst_dir / (src.stem().string() + pat.extension);
+        auto dsize   = fs::file_size(dst, ec);
+        if (ec || dsize != size) continue;
+        auto dtime = fs::last_write_time(dst, ec);
+        if (!ec && dtime >= mtime) return true;
+    }
+    return false;
+}
+
+struct DecryptTask {
+    fs::path src;
+    fs::path dst_dir;
+};
+
+// 请求里的字符串在 RPC 返回后就释放了，后台批次用自己的副本
+struct DecryptArgs {
+    std::string src;
+    std::vector<std::string> files;
+    std::string dst;
+    uint32_t workers;
+    bool force;
+};
+
+struct DecryptBatch {
+    uint64_t id;
+    DecryptArgs args;
+    std::thread thread;
+    std::atomic<bool> cancel { false };
+    DecProgress_t progress = {}; // 受 batchMutex 保护
+};
+
+static std::mutex batchMutex;
+static std::map<uint64_t, std::unique_ptr<DecryptBatch>> batches; // 运行中和最近结束的批次
+static uint64_t nextBatch  = 1;
+static bool batchesStopped = false;
+
+static std::vector<DecryptTask> collect_decrypt_tasks(const DecryptArgs &args, const std::atomic<bool> &cancel)
+{
+    std::vector<DecryptTask> tasks;
+    fs::path dst(args.dst);
+    if (!args.src.empty()) {
+        fs::path root(args.src);
+        std::error_code ec;
+        fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end;
+        if (ec) {
+            LOG_ERROR("无法打开目录: {}", root.string());
+        }
+        for (; !ec && it != end && !cancel; it.increment(ec)) {
+            const auto &path = it->path();
+            if (path.extension() != ".dat" || !it->is_regular_file(ec)) continue;
+            tasks.push_back({ path, dst / path.parent_path().lexically_relative(root) });
+        }
+    }
+    for (const auto &file : args.files) {
+        tasks.push_back({ fs::path(file), dst });
+    }
+    return tasks;
+}
+
+static void push_decrypt_progress(const DecProgress_t &progress)
+{
+    auto &handler = message::Handler::getInstance();
+    if (handler.isMessageListening()) {
+        WxMsg_t msg = {};
+        msg.type    = DECRYPT_PROGRESS_MSG_TYPE;
+        msg.ts      = static_cast<uint32_t>(time(nullptr));
+        msg.dec     = progress;
+        msg.dec->errors.clear();
+        handler.pushMessage(std::move(msg));
+    }
+}
+
+// 在批次线程里执行，工作线程解密，本线程定时汇总进度
+static void run_decrypt_batch(DecryptBatch &batch)
+{
+    auto started     = std::chrono::steady_clock::now();
+    const auto &args = batch.args;
+    auto tasks       = collect_decrypt_tasks(args, batch.cancel);
+    uint32_t total   = static_cast<uint32_t>(tasks.size());
+    size_t nworkers  = args.workers ? args.workers : std::thread::hardware_concurrency();
+    nworkers         = std::clamp<size_t>(nworkers, 1, MAX_DECRYPT_WORKERS);
+    nworkers         = std::min<size_t>(nworkers, tasks.size());
+
+    std::atomic<size_t> next { 0 };
+    std::atomic<uint32_t> done { 0 }, decrypted { 0 }, skipped { 0 }, failed { 0 };
+    std::atomic<uint64_t> bytes { 0 };
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::string> errors;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < tasks.size() && !batch.cancel; i = next++) {
+            const auto &task = tasks[i];
+            bool ok          = false;
+            try {
+                if (!args.force && is_decrypted(task.src, task.dst_dir)) {
+                    skipped++;
+                    ok = true;
+                } else if (!decrypt_file(task.src, task.dst_dir).empty()) {
+                    std::error_code ec;
+                    auto size = fs::file_size(task.src, ec);
+                    bytes += ec ? 0 : size;
+                    decrypted++;
+                    ok = true;
+                }
+            } catch (const std::exception &e) {
+                LOG_ERROR("解密失败: {}, {}", task.src.string(), e.what());
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ok) {
+                failed++;
+                if (errors.size() < MAX_DECRYPT_ERRORS) {
+                    errors.push_back(task.src.string());
+                }
+            }
+            ++done;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_one();
+    };
+
+    auto snapshot = [&]() {
+        DecProgress_t p = {};
+        p.batch         = batch.id;
+        p.total         = total;
+        p.done          = done;
+        p.decrypted     = decrypted;
+        p.skipped       = skipped;
+        p.failed        = failed;
+        p.bytes         = bytes;
+        p.elapsed_ms    = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                 std::chrono::steady_clock::now() - started)
+                                                 .count());
+        return p;
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nworkers; i++) {
+        threads.emplace_back(worker);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!cv.wait_for(lock, DECRYPT_PROGRESS_INTERVAL, [&]() { return done == total || batch.cancel; })) {
+            auto progress = snapshot();
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> guard(batchMutex);
+                batch.progress = progress;
+            }
+            push_decrypt_progress(progress);
+            lock.lock();
+        }
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    DecProgress_t summary = snapshot();
+    summary.errors        = std::move(errors);
+    summary.finished      = true;
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        batch.progress = summary;
+    }
+    push_decrypt_progress(summary);
+    LOG_INFO("批量解密 {} 完成: 共 {}，解密 {}，跳过 {}，失败 {}，耗时 {}ms", batch.id, summary.total,
+             summary.decrypted, summary.skipped, summary.failed, summary.elapsed_ms);
+}
+
+// 调用方持有 batchMutex；结束的批次只保留最近几个，线程已退出，join 不会等
+static void reap_decrypt_batches()
+{
+    size_t finished = 0;
+    for (const auto &[id, b] : batches) {
+        finished += b->progress.finished ? 1 : 0;
+    }
+    for (auto it = batches.begin(); it != batches.end() && finished > MAX_DECRYPT_RESULTS;) {
+        if (!it->second->progress.finished) {
+            ++it;
+            continue;
+        }
+        if (it->second->thread.joinable()) {
+            it->second->thread.join();
+        }
+        it = batches.erase(it);
+        finished--;
+    }
+}
+
+uint64_t decrypt_images(const DecBatch &db)
+{
+    if (!db.dst || !*db.dst) {
+        LOG_ERROR("目标目录为空");
+        return 0;
+    }
+
+    auto batch          = std::make_unique<DecryptBatch>();
+    batch->args.src     = db.src ? db.src : "";
+    batch->args.dst     = db.dst;
+    batch->args.workers = db.workers;
+    batch->args.force   = db.force;
+    for (pb_size_t i = 0; i < db.files_count; i++) {
+        if (db.files[i] && *db.files[i]) {
+            batch->args.files.emplace_back(db.files[i]);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(batchMutex);
+    reap_decrypt_batches();
+    size_t running = std::count_if(batches.begin(), batches.end(),
+                                   [](const auto &b) { return !b.second->progress.finished; });
+    if (batchesStopped || running >= MAX_DECRYPT_BATCHES) {
+        LOG_ERROR("无法启动批量解密: 已停止或同时运行的批次太多 ({})", running);
+        return 0;
+    }
+
+    batch->id             = nextBatch++;
+    batch->progress.batch = batch->id;
+    DecryptBatch *b       = batch.get();
+    b->thread             = std::thread([b]() { run_decrypt_batch(*b); });
+    batches.emplace(b->id, std::move(batch));
+    return b->id;
+}
+
+DecProgress_t query_decrypt(uint64_t batch)
+{
+    std::lock_guard<std::mutex> lock(batchMutex);
+    auto it = batches.find(batch);
+    return it == batches.end() ? DecProgress_t {} : it->second->progress;
+}
 
-    out.write(buffer.data(), buffer.size());
-    return dst_path.generic_string();
+void stop_decrypt()
+{
+    std::map<uint64_t, std::unique_ptr<DecryptBatch>> stopping;
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        batchesStopped = true;
+        stopping.swap(batches);
+    }
+    for (auto &[id, b] : stopping) {
+        b->cancel = true;
+        if (b->thread.joinable()) {
+            b->thread.join();
+        }
+    }
 }
 
 static int get_first_page()
@@ -151,6 +521,12 @@ int refresh_pyq(uint64_t id)
  * extra：图片、文件的路径
  *******************************************************************************/
 int download_attachment(uint64_t id, const fs::path &thumb, const fs::path &extra)
+{
+    fs::path save_path;
+    return download_attachment(id, thumb, extra, save_path);
+}
+
+int download_attachment(uint64_t id, const fs::path &thumb, const fs::path &extra, fs::path &save_path)
 {
     int status = -1;
     QWORD localId;
@@ -158,6 +534,7 @@ int download_attachment(uint64_t id, const fs::path &thumb, const fs::path &extr
 
     if (fs::exists(extra)) { // 第一道，不重复下载。TODO: 通过文件大小来判断
         LOG_WARN("文件已存在：{}", extra.generic_string());
+        save_path = extra;
         return 0;
     }
 
@@ -188,7 +565,7 @@ int download_attachment(uint64_t id, const fs::path &thumb, const fs::path &extr
     GetMgrByPrefixLocalId(l.QuadPart, pChatMsg);
     QWORD type = util::get_qword(reinterpret_cast<QWORD>(buff) + 0x38);
 
-    fs::path save_path, thumb_path;
+    fs::path thumb_path;
     switch (type) {
         case 0x03: { // Image: extra
             save_path = extra;
@@ -233,6 +610,32 @@ int download_attachment(uint64_t id, const fs::path &thumb, const fs::path &extr
     return status;
 }
 
+std::string save_audio(uint64_t id, std::vector<uint8_t> &silk, const fs::path &path, int32_t sr)
+{
+    bool mp3        = path.extension() == ".mp3";
+    std::string ext = mp3 ? "mp3" : "pcm";
+
+    // 同一条语音换个目录再要，直接从缓存复制，不用重新转码
+    auto &cache     = MediaCache::get_instance();
+    std::string key = MediaCache::make_key(ext + std::to_string(sr), id, silk.data(), silk.size());
+    if (auto hit = cache.lookup(key); hit && copy_file_atomic(*hit, path)) {
+        return path.generic_string();
+    }
+
+    std::vector<uint8_t> data;
+    if (mp3) {
+        Silk2Mp3(silk, data, sr);
+    } else {
+        SilkDecode(silk, data, sr);
+    }
+    if (data.empty() || !write_file_atomic(path, data.data(), data.size())) {
+        LOG_ERROR("转码失败: {}", id);
+        return "";
+    }
+    cache.store(key, "." + ext, data.data(), data.size());
+    return path.generic_string();
+}
+
 std::string get_audio(uint64_t id, const fs::path &dir)
 {
     if (!fs::exists(dir)) fs::create_directories(dir);
@@ -246,8 +649,7 @@ std::string get_audio(uint64_t id, const fs::path &dir)
         return "";
     }
 
-    Silk2Mp3(silk, mp3path.generic_string(), 24000);
-    return mp3path.generic_string();
+    return save_audio(id, silk, mp3path, 24000);
 }
 
 std::string get_pcm_audio(uint64_t id, const fs::path &dir, int32_t sr)
@@ -263,17 +665,7 @@ std::string get_pcm_audio(uint64_t id, const fs::path &dir, int32_t sr)
         return "";
     }
 
-    std::vector<uint8_t> pcm;
-    SilkDecode(silk, pcm, sr);
-
-    std::ofstream out(pcmpath, std::ios::binary);
-    if (!out) {
-        LOG_ERROR("创建文件失败: {}", pcmpath.generic_string());
-        return "";
-    }
-
-    out.write(reinterpret_cast<char *>(pcm.data()), pcm.size());
-    return pcmpath.generic_string();
+    return save_audio(id, silk, pcmpath, sr);
 }
 
 OcrResult_t get_ocr_result(const fs::path &path)
@@ -364,14 +756,54 @@ bool rpc_get_audio(const AudioMsg &am, uint8_t *out, size_t *len)
         out, len, [&](Response &rsp) { rsp.msg.str = (char *)get_audio(am.id, am.dir).c_str(); });
 }
 
-bool rpc_get_pcm_audio(uint64_t id, const fs::path &dir, int32_t sr, uint8_t *out, size_t *len) { return false; }
-
 bool rpc_decrypt_image(const DecPath &dec, uint8_t *out, size_t *len)
 {
     return fill_response<Functions_FUNC_DECRYPT_IMAGE>(
         out, len, [&](Response &rsp) { rsp.msg.str = (char *)decrypt_image(dec.src, dec.dst).c_str(); });
 }
 
+static void fill_dec_progress(Response &rsp, DecProgress_t &progress)
+{
+    rsp.msg.dec.total               = progress.total;
+    rsp.msg.dec.done                = progress.done;
+    rsp.msg.dec.decrypted           = progress.decrypted;
+    rsp.msg.dec.skipped             = progress.skipped;
+    rsp.msg.dec.failed              = progress.failed;
+    rsp.msg.dec.bytes               = progress.bytes;
+    rsp.msg.dec.elapsed_ms          = progress.elapsed_ms;
+    rsp.msg.dec.batch               = progress.batch;
+    rsp.msg.dec.finished            = progress.finished;
+    rsp.msg.dec.errors.funcs.encode = encode_strings;
+    rsp.msg.dec.errors.arg          = &progress.errors;
+}
+
+bool rpc_decrypt_images(const DecBatch &db, uint8_t *out, size_t *len)
+{
+    DecProgress_t progress = {};
+    progress.batch         = decrypt_images(db);
+    return fill_response<Functions_FUNC_DECRYPT_IMAGES>(out, len,
+                                                        [&](Response &rsp) { fill_dec_progress(rsp, progress); });
+}
+
+bool rpc_query_decrypt(uint64_t batch, uint8_t *out, size_t *len)
+{
+    DecProgress_t progress = query_decrypt(batch);
+    return fill_response<Functions_FUNC_GET_DECRYPT>(out, len,
+                                                     [&](Response &rsp) { fill_dec_progress(rsp, progress); });
+}
+
+bool rpc_read_image(const DecRange &dr, uint8_t *out, size_t *len)
+{
+    ImageData_t img = read_image(dr.src ? dr.src : "", dr.offset, dr.size);
+    return fill_response<Functions_FUNC_READ_IMAGE>(out, len, [&](Response &rsp) {
+        rsp.msg.img.format            = (char *)img.format.c_str();
+        rsp.msg.img.total             = img.total;
+        rsp.msg.img.offset            = img.offset;
+        rsp.msg.img.data.funcs.encode = encode_bytes;
+        rsp.msg.img.data.arg          = &img.data;
+    });
+}
+
 bool rpc_get_login_url(uint8_t *out, size_t *len)
 {
     return fill_response<Functions_FUNC_REFRESH_QRCODE>(
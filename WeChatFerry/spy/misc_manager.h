@@ -1,4 +1,4 @@
-#pragma once
+﻿#pragma once
 
 #include <cstdint>
 #include <filesystem>
@@ -13,13 +13,33 @@
 namespace misc
 {
 
+// 批量解密进度的消息类型
+constexpr uint32_t DECRYPT_PROGRESS_MSG_TYPE = 0x10002;
+
 std::string get_audio(uint64_t id, const std::filesystem::path &dir);
 std::string get_pcm_audio(uint64_t id, const std::filesystem::path &dir, int32_t sr);
+
+// 把已取到的 SILK 数据转成 path 扩展名对应的格式（.mp3 或 .pcm），经过媒体缓存，返回 path，失败返回空
+std::string save_audio(uint64_t id, std::vector<uint8_t> &silk, const std::filesystem::path &path, int32_t sr);
 std::string decrypt_image(const std::filesystem::path &src, const std::filesystem::path &dst);
+
+// 在后台线程池里批量解密，跳过已解密过的文件，立即返回批次 id，参数错误或同时运行的批次太多时返回 0
+// 进度和汇总以 DECRYPT_PROGRESS_MSG_TYPE 消息推送（需开启消息接收），也可用 query_decrypt 查询
+uint64_t decrypt_images(const DecBatch &db);
+// 未知或已淘汰的批次 batch 为 0
+DecProgress_t query_decrypt(uint64_t batch);
+// 取消并等待所有批次，之后不再接受新批次
+void stop_decrypt();
+
+// 不落盘，直接读出解密后 [offset, offset + size) 的内容，大图分块读，每次只占一块的内存
+ImageData_t read_image(const std::filesystem::path &src, uint64_t offset, size_t size);
 std::string get_login_url();
 
 int refresh_pyq(uint64_t id);
 int download_attachment(uint64_t id, const std::filesystem::path &thumb, const std::filesystem::path &extra);
+// 同上，save_path 返回微信会把附件保存到哪里
+int download_attachment(uint64_t id, const std::filesystem::path &thumb, const std::filesystem::path &extra,
+                        std::filesystem::path &save_path);
 int revoke_message(uint64_t id);
 
 OcrResult_t get_ocr_result(const std::filesystem::path &path);
@@ -28,8 +48,10 @@ int receive_transfer(const std::string &wxid, const std::string &transferid, con
 // RPC
 // clang-format off
 bool rpc_get_audio(const AudioMsg &am, uint8_t *out, size_t *len);
-bool rpc_get_pcm_audio(uint64_t id, const std::filesystem::path &dir, int32_t sr, uint8_t *out, size_t *len);
 bool rpc_decrypt_image(const DecPath &dec, uint8_t *out, size_t *len);
+bool rpc_decrypt_images(const DecBatch &db, uint8_t *out, size_t *len);
+bool rpc_query_decrypt(uint64_t batch, uint8_t *out, size_t *len);
+bool rpc_read_image(const DecRange &dr, uint8_t *out, size_t *len);
 bool rpc_get_login_url(uint8_t *out, size_t *len);
 bool rpc_refresh_pyq(uint64_t id, uint8_t *out, size_t *len);
 bool rpc_download_attachment(const AttachMsg &att, uint8_t *out, size_t *len);
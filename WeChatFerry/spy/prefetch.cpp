@@ -0,0 +1,343 @@
+﻿#include "prefetch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "download_manager.h"
+#include "log.hpp"
+#include "message_parser.h"
+#include "rpc_helper.h"
+
+namespace prefetch
+{
+
+namespace fs = std::filesystem;
+using Clock  = std::chrono::steady_clock;
+
+#define MAX_QUEUE_SIZE     1024
+#define MAX_ATTEMPTS       3
+#define DEFAULT_MAX_ACTIVE 2
+#define APP_TYPE_FILE      6
+
+// Hook 在微信写库之前触发，马上下载会查不到 localId
+static constexpr auto SETTLE_DELAY = std::chrono::milliseconds(1000);
+static constexpr auto BACKOFF_BASE = std::chrono::milliseconds(1000);
+static constexpr auto BACKOFF_MAX  = std::chrono::milliseconds(60000);
+
+struct Policy {
+    std::unordered_set<uint32_t> types;
+    std::unordered_set<std::string> rooms;
+    uint64_t maxSize;
+    uint32_t maxActive;
+    uint64_t bandwidth;
+};
+
+struct Item {
+    uint64_t msgid;
+    uint32_t type;
+    std::string thumb;
+    std::string extra;
+    uint64_t size; // 消息里标明的大小，0 为未知
+    uint32_t attempts;
+    Clock::time_point due;
+};
+
+static std::shared_ptr<const Policy> policy;
+
+static std::mutex queueMutex;
+static std::condition_variable queueCv;
+static std::deque<Item> pending;
+static std::unordered_map<uint64_t, Item> inflight; // 下载任务 id -> 预取项
+static bool running = false;
+static std::thread worker;
+
+// 以下由 queueMutex 保护
+static double tokens = 0; // 带宽令牌桶，允许透支，透支后等还清再提交下一个
+static Clock::time_point refill;
+static uint32_t failures = 0; // 连续失败次数，决定退避时长
+static Clock::time_point pausedUntil;
+static uint64_t queued    = 0;
+static uint64_t dropped   = 0;
+static uint64_t local     = 0;
+static uint64_t submitted = 0;
+static uint64_t done      = 0;
+static uint64_t failed    = 0;
+static uint64_t retried   = 0;
+static uint64_t bytes     = 0;
+
+static std::atomic<uint64_t> oversize { 0 };
+
+static std::shared_ptr<const Policy> current() { return std::atomic_load(&policy); }
+
+static bool supported(uint32_t type) { return type == 0x03 || type == 0x2B || type == 0x3E || type == 0x31; }
+
+static Clock::duration backoff(uint32_t n)
+{
+    auto wait = BACKOFF_BASE * (1u << std::min<uint32_t>(n - 1, 6));
+    return std::min<Clock::duration>(wait, BACKOFF_MAX);
+}
+
+// 已经在本地的不用再交给微信，路径规则与 download_attachment 一致
+static bool is_local(const Item &item)
+{
+    std::error_code ec;
+    if (item.type == 0x2B || item.type == 0x3E) {
+        return !item.thumb.empty() && fs::exists(fs::path(item.thumb).replace_extension("mp4"), ec);
+    }
+    return !item.extra.empty() && fs::exists(item.extra, ec);
+}
+
+// 以下调用方持有 queueMutex
+static void refill_tokens(const Policy &p, Clock::time_point now)
+{
+    if (p.bandwidth == 0) {
+        return;
+    }
+    double cap     = static_cast<double>(p.bandwidth);
+    double elapsed = std::chrono::duration<double>(now - refill).count();
+    tokens         = std::min(cap, tokens + elapsed * cap);
+    refill         = now;
+}
+
+// 队首可以提交的时间，max() 表示要等新消息或下载结束
+static Clock::time_point next_ready(const Policy &p, Clock::time_point now)
+{
+    if (pending.empty() || inflight.size() >= p.maxActive) {
+        return Clock::time_point::max();
+    }
+    auto ready = std::max(pending.front().due, pausedUntil);
+    if (p.bandwidth > 0 && tokens <= 0) {
+        auto debt = std::chrono::duration<double>((1.0 - tokens) / static_cast<double>(p.bandwidth));
+        ready     = std::max(ready, now + std::chrono::duration_cast<Clock::duration>(debt));
+    }
+    return ready;
+}
+
+// 失败后整体暂停一段时间再继续，连续失败时退避翻倍；同一条消息最多试 MAX_ATTEMPTS 次
+static void on_failure(Item item, Clock::time_point now)
+{
+    failures++;
+    auto wait   = backoff(failures);
+    pausedUntil = now + wait;
+    if (item.attempts >= MAX_ATTEMPTS) {
+        failed++;
+        LOG_WARN("Prefetch gave up on message {}", item.msgid);
+        return;
+    }
+    retried++;
+    item.due = now + wait;
+    pending.push_back(std::move(item));
+}
+
+static void on_result(const DownloadResult_t &r)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        auto it = inflight.find(r.job);
+        if (it == inflight.end()) {
+            return; // 不是预取提交的
+        }
+        Item item = std::move(it->second);
+        inflight.erase(it);
+
+        switch (r.state) {
+            case DownloadResult_State_DONE:
+                done++;
+                bytes += r.size;
+                failures = 0;
+                if (item.size == 0) {
+                    tokens -= static_cast<double>(r.size); // 提交时不知道大小，按实际大小补扣
+                }
+                break;
+            case DownloadResult_State_CANCELLED:
+                break; // 被调用方取消，不再重试
+            default:
+                on_failure(std::move(item), Clock::now());
+                break;
+        }
+    }
+    queueCv.notify_one();
+}
+
+static void work()
+{
+    auto &downloads = misc::DownloadManager::get_instance();
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (running) {
+        auto p = current();
+        if (!p) {
+            queueCv.wait(lock);
+            continue;
+        }
+
+        auto now = Clock::now();
+        refill_tokens(*p, now);
+        auto ready = next_ready(*p, now);
+        if (ready == Clock::time_point::max()) {
+            queueCv.wait(lock);
+            continue;
+        }
+        if (ready > now) {
+            queueCv.wait_until(lock, ready);
+            continue;
+        }
+
+        Item item = std::move(pending.front());
+        pending.pop_front();
+        if (is_local(item)) {
+            local++;
+            continue;
+        }
+
+        item.attempts++;
+        tokens -= static_cast<double>(item.size);
+        // 持锁提交，下载结果回调也要拿这把锁，保证回调时任务已经登记
+        uint64_t job = downloads.submit(item.msgid, item.thumb, item.extra);
+        if (job == 0) {
+            on_failure(std::move(item), now);
+            continue;
+        }
+        submitted++;
+        inflight.emplace(job, std::move(item));
+    }
+}
+
+int set_policy(const PrefetchPolicy &pp)
+{
+    if (pp.types_count == 0) {
+        stop();
+        LOG_INFO("Prefetch disabled");
+        return 0;
+    }
+
+    auto p = std::make_shared<Policy>();
+    for (pb_size_t i = 0; i < pp.types_count; i++) {
+        if (!supported(pp.types[i])) {
+            LOG_ERROR("Prefetch does not support type {}", pp.types[i]);
+            return -1;
+        }
+        p->types.insert(pp.types[i]);
+    }
+    for (pb_size_t i = 0; i < pp.rooms_count; i++) {
+        if (pp.rooms[i] && pp.rooms[i][0] != '\0') p->rooms.emplace(pp.rooms[i]);
+    }
+    p->maxSize   = pp.max_size;
+    p->maxActive = pp.max_active ? pp.max_active : DEFAULT_MAX_ACTIVE;
+    p->bandwidth = pp.bandwidth;
+
+    int count = static_cast<int>(p->types.size());
+    LOG_INFO("Prefetch policy: {} types, {} rooms, max size {}, active {}, bandwidth {}B/s", count, p->rooms.size(),
+             p->maxSize, p->maxActive, p->bandwidth);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        tokens = static_cast<double>(p->bandwidth);
+        refill = Clock::now();
+        std::atomic_store(&policy, std::shared_ptr<const Policy>(std::move(p)));
+        if (!running) {
+            running = true;
+            misc::DownloadManager::get_instance().set_listener(on_result);
+            worker = std::thread(work);
+        }
+    }
+    queueCv.notify_all();
+    return count;
+}
+
+bool is_active() { return current() != nullptr; }
+
+void post(const WxMsg_t &msg)
+{
+    auto p = current();
+    if (!p || msg.id == 0) {
+        return;
+    }
+
+    // 文件的类型可能带着 appmsg 子类型，低 16 位为 0x31
+    uint32_t type = ((msg.type & 0xFFFF) == 0x31) ? 0x31 : msg.type;
+    if (p->types.count(type) == 0) return;
+    if (!p->rooms.empty() && p->rooms.count(msg.roomid) == 0) return;
+    if (msg.thumb.empty() && msg.extra.empty()) return;
+
+    MsgFields_t f = message::parse_fields(type, msg.content, "");
+    if (type == 0x31 && f.app_type != APP_TYPE_FILE) {
+        return; // 链接、小程序等没有附件
+    }
+    if (p->maxSize > 0 && f.size > p->maxSize) {
+        oversize++;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running) {
+            return;
+        }
+        if (pending.size() >= MAX_QUEUE_SIZE) {
+            dropped++;
+            return;
+        }
+        pending.push_back({ msg.id, type, msg.thumb, msg.extra, f.size, 0, Clock::now() + SETTLE_DELAY });
+        queued++;
+    }
+    queueCv.notify_one();
+}
+
+void stop()
+{
+    std::atomic_store(&policy, std::shared_ptr<const Policy>());
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+        pending.clear();
+        // 已提交的下载由 DownloadManager 继续完成，这里不再跟踪
+        inflight.clear();
+        misc::DownloadManager::get_instance().set_listener(nullptr);
+    }
+    queueCv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void collect_stats(Stats_t &stats)
+{
+    stats["prefetch.oversize"] = oversize.load();
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    auto now   = Clock::now();
+    auto pause = pausedUntil > now ? pausedUntil - now : Clock::duration::zero();
+
+    stats["prefetch.pending"]    = pending.size();
+    stats["prefetch.active"]     = inflight.size();
+    stats["prefetch.queued"]     = queued;
+    stats["prefetch.dropped"]    = dropped;
+    stats["prefetch.local"]      = local;
+    stats["prefetch.submitted"]  = submitted;
+    stats["prefetch.done"]       = done;
+    stats["prefetch.failed"]     = failed;
+    stats["prefetch.retried"]    = retried;
+    stats["prefetch.bytes"]      = bytes;
+    stats["prefetch.backoff_ms"] = std::chrono::duration_cast<std::chrono::milliseconds>(pause).count();
+}
+
+bool rpc_set_policy(const PrefetchPolicy &pp, uint8_t *out, size_t *len)
+{
+    return fill_response<Functions_FUNC_SET_PREFETCH>(out, len,
+                                                      [&](Response &rsp) { rsp.msg.status = set_policy(pp); });
+}
+
+} // namespace prefetch
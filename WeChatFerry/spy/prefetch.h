@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "wcf.pb.h"
+
+#include "pb_types.h"
+
+namespace prefetch
+{
+
+// 整体替换预取策略，types 为空时关闭并清空待预取队列，已提交的下载继续完成
+// 消息来自接收 Hook，需先开启消息接收（FUNC_ENABLE_RECV_TXT）；下载走 DownloadManager，结果同样以 0x10004 推送
+// 返回类型数，有不支持的类型返回 -1
+int set_policy(const PrefetchPolicy &policy);
+
+// 是否已设置策略，Hook 据此决定要不要读 content、thumb、extra
+bool is_active();
+
+// Hook 线程调用，只做过滤和入队；微信写库后才能下载，实际提交会延后一会
+void post(const WxMsg_t &msg);
+
+// 停止预取线程并清空策略
+void stop();
+
+void collect_stats(Stats_t &stats);
+
+// RPC 方法
+bool rpc_set_policy(const PrefetchPolicy &policy, uint8_t *out, size_t *len);
+
+} // namespace prefetch
@@ -16,6 +16,7 @@ static const std::unordered_map<Functions, int> rpc_tag_map
         { Functions_FUNC_GET_USER_INFO, Response_ui_tag },
         { Functions_FUNC_GET_MSG_TYPES, Response_types_tag },
         { Functions_FUNC_GET_CONTACTS, Response_contacts_tag },
+        { Functions_FUNC_GET_CONTACTS_SINCE, Response_delta_tag },
         { Functions_FUNC_GET_DB_NAMES, Response_dbs_tag },
         { Functions_FUNC_GET_DB_TABLES, Response_tables_tag },
         { Functions_FUNC_GET_AUDIO_MSG, Response_str_tag },
@@ -26,22 +27,48 @@ static const std::unordered_map<Functions, int> rpc_tag_map
         { Functions_FUNC_SEND_RICH_TXT, Response_status_tag },
         { Functions_FUNC_SEND_PAT_MSG, Response_status_tag },
         { Functions_FUNC_FORWARD_MSG, Response_status_tag },
+        { Functions_FUNC_GET_SEND_RESULT, Response_sent_tag },
+        { Functions_FUNC_SET_SEND_LIMITS, Response_status_tag },
+        { Functions_FUNC_BROADCAST, Response_jobs_tag },
+        { Functions_FUNC_FORWARD_MSGS, Response_statuses_tag },
+        { Functions_FUNC_SEND_PATS, Response_statuses_tag },
+        { Functions_FUNC_UPLOAD_FILE, Response_up_tag },
         { Functions_FUNC_SEND_EMOTION, Response_status_tag },
         { Functions_FUNC_ENABLE_RECV_TXT, Response_status_tag },
         { Functions_FUNC_DISABLE_RECV_TXT, Response_status_tag },
         { Functions_FUNC_EXEC_DB_QUERY, Response_rows_tag },
+        { Functions_FUNC_EXEC_DB_ARROW, Response_arrow_tag },
         { Functions_FUNC_REFRESH_PYQ, Response_status_tag },
         { Functions_FUNC_DOWNLOAD_ATTACH, Response_status_tag },
+        { Functions_FUNC_DOWNLOAD_ASYNC, Response_job_tag },
+        { Functions_FUNC_GET_DOWNLOAD, Response_dl_tag },
+        { Functions_FUNC_CANCEL_DOWNLOAD, Response_status_tag },
+        { Functions_FUNC_SET_DOWNLOAD_LIMIT, Response_status_tag },
+        { Functions_FUNC_SET_PREFETCH, Response_status_tag },
         { Functions_FUNC_GET_CONTACT_INFO, Response_contacts_tag },
+        { Functions_FUNC_RESOLVE_CONTACTS, Response_contacts_tag },
+        { Functions_FUNC_GET_STATS, Response_stats_tag },
+        { Functions_FUNC_READ_AUDIO, Response_audio_tag },
+        { Functions_FUNC_GET_AUDIO_MSGS, Response_audios_tag },
+        { Functions_FUNC_GET_AUDIO_JOB, Response_audios_tag },
+        { Functions_FUNC_ENABLE_MSG_ENRICH, Response_status_tag },
+        { Functions_FUNC_SET_KEYWORD_RULES, Response_status_tag },
+        { Functions_FUNC_SET_REPLY_RULES, Response_status_tag },
         { Functions_FUNC_ACCEPT_FRIEND, Response_status_tag },
         { Functions_FUNC_RECV_TRANSFER, Response_status_tag },
         { Functions_FUNC_REVOKE_MSG, Response_status_tag },
         { Functions_FUNC_REFRESH_QRCODE, Response_str_tag },
         { Functions_FUNC_DECRYPT_IMAGE, Response_str_tag },
+        { Functions_FUNC_DECRYPT_IMAGES, Response_dec_tag },
+        { Functions_FUNC_GET_DECRYPT, Response_dec_tag },
+        { Functions_FUNC_READ_IMAGE, Response_img_tag },
+        { Functions_FUNC_SET_MEDIA_CACHE, Response_status_tag },
         { Functions_FUNC_EXEC_OCR, Response_ocr_tag },
         { Functions_FUNC_ADD_ROOM_MEMBERS, Response_status_tag },
         { Functions_FUNC_DEL_ROOM_MEMBERS, Response_status_tag },
-        { Functions_FUNC_INV_ROOM_MEMBERS, Response_status_tag } };
+        { Functions_FUNC_INV_ROOM_MEMBERS, Response_status_tag },
+        { Functions_FUNC_GET_ROOM_MEMBERS, Response_rooms_tag },
+        { Functions_FUNC_BATCH_ROOM_MEMBERS, Response_rooms_tag } };
 
 template <Functions FuncType, typename AssignFunc> bool fill_response(uint8_t *out, size_t *len, AssignFunc assign)
 {
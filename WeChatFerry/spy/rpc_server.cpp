@@ -18,18 +18,28 @@
 #include <nng/supplemental/util/platform.h>
 
 #include "account_manager.h"
+#include "audio_stream.h"
+#include "auto_reply.h"
 #include "chatroom_manager.h"
 #include "contact_manager.h"
 #include "database_executor.h"
+#include "download_manager.h"
+#include "keyword_engine.h"
 #include "log.hpp"
+#include "media_cache.h"
+#include "media_registry.h"
 #include "message_handler.h"
+#include "message_parser.h"
 #include "message_sender.h"
 #include "misc_manager.h"
 #include "pb_types.h"
 #include "pb_util.h"
+#include "prefetch.h"
 #include "rpc_helper.h"
+#include "send_queue.h"
 #include "spy.h"
 #include "spy_types.h"
+#include "upload_store.h"
 #include "util.h"
 
 namespace fs = std::filesystem;
@@ -105,6 +115,14 @@ int RpcServer::stop()
 
     handler_.UnListenPyq();
     handler_.UnListenMsg();
+    chatroom::stop_room_watch();
+    contact::stop_refresh();
+    autoreply::stop();
+    prefetch::stop();
+    message::SendQueue::get_instance().stop();
+    misc::DownloadManager::get_instance().stop();
+    misc::stop_decrypt();
+    misc::stop_audios();
 #if ENABLE_WX_LOG
     handler_.DisableLog();
 #endif
@@ -174,19 +192,112 @@ void RpcServer::on_message_callback()
                 continue;
             }
 
-            WxMsg_t wxmsg          = std::move(msgOpt.value());
-            rsp.msg.wxmsg.id       = wxmsg.id;
-            rsp.msg.wxmsg.is_self  = wxmsg.is_self;
-            rsp.msg.wxmsg.is_group = wxmsg.is_group;
-            rsp.msg.wxmsg.type     = wxmsg.type;
-            rsp.msg.wxmsg.ts       = wxmsg.ts;
-            rsp.msg.wxmsg.roomid   = (char *)wxmsg.roomid.c_str();
-            rsp.msg.wxmsg.content  = (char *)wxmsg.content.c_str();
-            rsp.msg.wxmsg.sender   = (char *)wxmsg.sender.c_str();
-            rsp.msg.wxmsg.sign     = (char *)wxmsg.sign.c_str();
-            rsp.msg.wxmsg.thumb    = (char *)wxmsg.thumb.c_str();
-            rsp.msg.wxmsg.extra    = (char *)wxmsg.extra.c_str();
-            rsp.msg.wxmsg.xml      = (char *)wxmsg.xml.c_str();
+            WxMsg_t wxmsg = std::move(msgOpt.value());
+            if (!keyword::apply(wxmsg)) {
+                continue; // 未命中任何关键词规则，按 suppress 丢弃
+            }
+            if (handler_.isEnrichEnabled()) {
+                handler_.EnrichMsg(wxmsg);
+            }
+
+            FieldMask_t mask = handler_.getMessageMask();
+            auto want        = [mask](uint32_t tag) { return has_field(mask, tag); };
+            auto str         = [&](uint32_t tag, const std::string &s) {
+                return want(tag) ? const_cast<char *>(s.c_str()) : nullptr;
+            };
+            auto cb_str = [](pb_callback_t &cb, const std::string &s) {
+                cb.funcs.encode = s.empty() ? nullptr : encode_string;
+                cb.arg          = (void *)s.c_str();
+            };
+
+            if (want(WxMsg_fields_tag) && !is_notice(wxmsg) && wxmsg.type != 0x00) {
+                wxmsg.fields = message::parse_fields(wxmsg.type, wxmsg.content, wxmsg.xml);
+            }
+
+            rsp.msg.wxmsg.id          = want(WxMsg_id_tag) ? wxmsg.id : 0;
+            rsp.msg.wxmsg.is_self     = want(WxMsg_is_self_tag) && wxmsg.is_self;
+            rsp.msg.wxmsg.is_group    = want(WxMsg_is_group_tag) && wxmsg.is_group;
+            rsp.msg.wxmsg.type        = want(WxMsg_type_tag) ? wxmsg.type : 0;
+            rsp.msg.wxmsg.ts          = want(WxMsg_ts_tag) ? wxmsg.ts : 0;
+            rsp.msg.wxmsg.roomid      = str(WxMsg_roomid_tag, wxmsg.roomid);
+            rsp.msg.wxmsg.content     = str(WxMsg_content_tag, wxmsg.content);
+            rsp.msg.wxmsg.sender      = str(WxMsg_sender_tag, wxmsg.sender);
+            rsp.msg.wxmsg.sign        = str(WxMsg_sign_tag, wxmsg.sign);
+            rsp.msg.wxmsg.thumb       = str(WxMsg_thumb_tag, wxmsg.thumb);
+            rsp.msg.wxmsg.extra       = str(WxMsg_extra_tag, wxmsg.extra);
+            rsp.msg.wxmsg.xml         = str(WxMsg_xml_tag, wxmsg.xml);
+            rsp.msg.wxmsg.sender_name = str(WxMsg_sender_name_tag, wxmsg.sender_name);
+            rsp.msg.wxmsg.room_alias  = str(WxMsg_room_alias_tag, wxmsg.room_alias);
+
+            rsp.msg.wxmsg.has_fields = wxmsg.fields.has_value();
+            if (rsp.msg.wxmsg.has_fields) {
+                MsgFields &f                = rsp.msg.wxmsg.fields;
+                f.at_users.funcs.encode     = wxmsg.fields->at_users.empty() ? nullptr : encode_strings;
+                f.at_users.arg              = &wxmsg.fields->at_users;
+                f.quoted_id                 = wxmsg.fields->quoted_id;
+                f.app_type                  = wxmsg.fields->app_type;
+                f.size                      = wxmsg.fields->size;
+                f.width                     = wxmsg.fields->width;
+                f.height                    = wxmsg.fields->height;
+                cb_str(f.title, wxmsg.fields->title);
+                cb_str(f.url, wxmsg.fields->url);
+                cb_str(f.md5, wxmsg.fields->md5);
+            }
+
+            rsp.msg.wxmsg.rule_ids_count = want(WxMsg_rule_ids_tag) ? static_cast<pb_size_t>(wxmsg.rule_ids.size()) : 0;
+            rsp.msg.wxmsg.rule_ids       = wxmsg.rule_ids.data();
+
+            rsp.msg.wxmsg.has_sent = want(WxMsg_sent_tag) && wxmsg.sent.has_value();
+            if (rsp.msg.wxmsg.has_sent) {
+                rsp.msg.wxmsg.sent.job      = wxmsg.sent->job;
+                rsp.msg.wxmsg.sent.func     = static_cast<Functions>(wxmsg.sent->func);
+                rsp.msg.wxmsg.sent.receiver = const_cast<char *>(wxmsg.sent->receiver.c_str());
+                rsp.msg.wxmsg.sent.state    = static_cast<SendResult_State>(wxmsg.sent->state);
+                rsp.msg.wxmsg.sent.status   = wxmsg.sent->status;
+                rsp.msg.wxmsg.sent.wait_ms  = wxmsg.sent->wait_ms;
+                rsp.msg.wxmsg.sent.run_ms   = wxmsg.sent->run_ms;
+            }
+
+            rsp.msg.wxmsg.has_dec = want(WxMsg_dec_tag) && wxmsg.dec.has_value();
+            if (rsp.msg.wxmsg.has_dec) {
+                rsp.msg.wxmsg.dec.total      = wxmsg.dec->total;
+                rsp.msg.wxmsg.dec.done       = wxmsg.dec->done;
+                rsp.msg.wxmsg.dec.decrypted  = wxmsg.dec->decrypted;
+                rsp.msg.wxmsg.dec.skipped    = wxmsg.dec->skipped;
+                rsp.msg.wxmsg.dec.failed     = wxmsg.dec->failed;
+                rsp.msg.wxmsg.dec.bytes      = wxmsg.dec->bytes;
+                rsp.msg.wxmsg.dec.elapsed_ms = wxmsg.dec->elapsed_ms;
+                rsp.msg.wxmsg.dec.batch      = wxmsg.dec->batch;
+                rsp.msg.wxmsg.dec.finished   = wxmsg.dec->finished;
+            }
+
+            rsp.msg.wxmsg.has_audio = want(WxMsg_audio_tag) && wxmsg.audio.has_value();
+            if (rsp.msg.wxmsg.has_audio) {
+                rsp.msg.wxmsg.audio.id   = wxmsg.audio->id;
+                rsp.msg.wxmsg.audio.path = const_cast<char *>(wxmsg.audio->path.c_str());
+                rsp.msg.wxmsg.audio.ms   = wxmsg.audio->ms;
+                rsp.msg.wxmsg.audio.job  = wxmsg.audio->job;
+            }
+
+            rsp.msg.wxmsg.has_dl = want(WxMsg_dl_tag) && wxmsg.dl.has_value();
+            if (rsp.msg.wxmsg.has_dl) {
+                rsp.msg.wxmsg.dl.job     = wxmsg.dl->job;
+                rsp.msg.wxmsg.dl.id      = wxmsg.dl->id;
+                rsp.msg.wxmsg.dl.path    = const_cast<char *>(wxmsg.dl->path.c_str());
+                rsp.msg.wxmsg.dl.size    = wxmsg.dl->size;
+                rsp.msg.wxmsg.dl.state   = static_cast<DownloadResult_State>(wxmsg.dl->state);
+                rsp.msg.wxmsg.dl.status  = wxmsg.dl->status;
+                rsp.msg.wxmsg.dl.wait_ms = wxmsg.dl->wait_ms;
+                rsp.msg.wxmsg.dl.run_ms  = wxmsg.dl->run_ms;
+            }
+
+            rsp.msg.wxmsg.has_event = want(WxMsg_event_tag) && wxmsg.event.has_value();
+            if (rsp.msg.wxmsg.has_event) {
+                rsp.msg.wxmsg.event.type               = static_cast<RoomEvent_Type>(wxmsg.event->type);
+                rsp.msg.wxmsg.event.count              = wxmsg.event->count;
+                rsp.msg.wxmsg.event.wxids.funcs.encode = encode_strings;
+                rsp.msg.wxmsg.event.wxids.arg          = &wxmsg.event->wxids;
+            }
 
             LOG_DEBUG("Push msg: {}", wxmsg.content);
             pb_ostream_t stream = pb_ostream_from_buffer(msgBuffer.data(), msgBuffer.size());
@@ -210,25 +321,48 @@ void RpcServer::on_message_callback()
     }
 }
 
-bool RpcServer::start_message_listener(bool pyq, uint8_t *out, size_t *len)
+bool RpcServer::start_message_listener(bool pyq, FieldMask_t mask, uint8_t *out, size_t *len)
 {
     return fill_response<Functions_FUNC_ENABLE_RECV_TXT>(out, len, [&](Response &rsp) {
+        handler_.setMessageMask(mask);
         rsp.msg.status = handler_.ListenMsg();
         if (rsp.msg.status == 0) {
             if (pyq) {
                 handler_.ListenPyq();
             }
+            chatroom::start_room_watch();
             msgThread_ = std::thread(&RpcServer::on_message_callback, this);
         }
     });
 }
 
+bool RpcServer::rpc_get_stats(uint8_t *out, size_t *len)
+{
+    Stats_t stats;
+    handler_.CollectStats(stats);
+    contact::collect_stats(stats);
+    chatroom::collect_stats(stats);
+    keyword::collect_stats(stats);
+    autoreply::collect_stats(stats);
+    message::SendQueue::get_instance().collect_stats(stats);
+    misc::MediaCache::get_instance().collect_stats(stats);
+    misc::DownloadManager::get_instance().collect_stats(stats);
+    prefetch::collect_stats(stats);
+    message::UploadStore::get_instance().collect_stats(stats);
+    message::MediaRegistry::get_instance().collect_stats(stats);
+    return fill_response<Functions_FUNC_GET_STATS>(out, len, [&](Response &rsp) {
+        rsp.msg.stats.values.funcs.encode = encode_stats;
+        rsp.msg.stats.values.arg          = &stats;
+    });
+}
+
 bool RpcServer::stop_message_listener(uint8_t *out, size_t *len)
 {
     return fill_response<Functions_FUNC_DISABLE_RECV_TXT>(out, len, [&](Response &rsp) {
         rsp.msg.status = handler_.UnListenMsg();
         if (rsp.msg.status == 0) {
             handler_.UnListenPyq();
+            chatroom::stop_room_watch();
             if (msgThread_.joinable()) {
                 msgThread_.join();
             }
@@ -242,12 +376,19 @@ const std::unordered_map<Functions, RpcServer::FunctionHandler> RpcServer::rpcFu
     { Functions_FUNC_GET_SELF_WXID, [](const Request &r, uint8_t *out, size_t *len) { return account::rpc_get_self_wxid(out, len); } },
     { Functions_FUNC_GET_USER_INFO, [](const Request &r, uint8_t *out, size_t *len) { return account::rpc_get_user_info(out, len); } },
     { Functions_FUNC_GET_MSG_TYPES, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().handler_.rpc_get_msg_types(out, len); } },
-    { Functions_FUNC_ENABLE_RECV_TXT, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().start_message_listener(r.msg.flag, out, len); } },
+    { Functions_FUNC_ENABLE_RECV_TXT, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().start_message_listener(r.msg.flag, r.mask, out, len); } },
+    { Functions_FUNC_ENABLE_MSG_ENRICH, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().handler_.rpc_enable_enrich(r.msg.flag, out, len); } },
+    { Functions_FUNC_SET_KEYWORD_RULES, [](const Request &r, uint8_t *out, size_t *len) { return keyword::rpc_set_rules(r.msg.kw, out, len); } },
+    { Functions_FUNC_SET_REPLY_RULES, [](const Request &r, uint8_t *out, size_t *len) { return autoreply::rpc_set_rules(r.msg.ar, out, len); } },
     { Functions_FUNC_DISABLE_RECV_TXT, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().stop_message_listener(out, len); } },
-    { Functions_FUNC_GET_CONTACTS, [](const Request &r, uint8_t *out, size_t *len) { return contact::rpc_get_contacts(out, len); } },
+    { Functions_FUNC_GET_CONTACTS, [](const Request &r, uint8_t *out, size_t *len) { return contact::rpc_get_contacts(r.mask, out, len); } },
+    { Functions_FUNC_GET_CONTACTS_SINCE, [](const Request &r, uint8_t *out, size_t *len) { return contact::rpc_get_contacts_since(r.msg.ui64, r.mask, out, len); } },
     { Functions_FUNC_GET_DB_NAMES, [](const Request &r, uint8_t *out, size_t *len) { return db::rpc_get_db_names(out, len); } },
-    { Functions_FUNC_GET_DB_TABLES, [](const Request &r, uint8_t *out, size_t *len) { return db::rpc_get_db_tables(r.msg.str, out, len); } },
+    { Functions_FUNC_GET_DB_TABLES, [](const Request &r, uint8_t *out, size_t *len) { return db::rpc_get_db_tables(r.msg.str, r.mask, out, len); } },
     { Functions_FUNC_GET_AUDIO_MSG, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_get_audio(r.msg.am, out, len); } },
+    { Functions_FUNC_READ_AUDIO, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_read_audio(r.msg.aud, out, len); } },
+    { Functions_FUNC_GET_AUDIO_MSGS, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_get_audios(r.msg.ab, out, len); } },
+    { Functions_FUNC_GET_AUDIO_JOB, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_query_audios(r.msg.ui64, out, len); } },
     { Functions_FUNC_SEND_TXT, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().sender_.rpc_send_text(r.msg.txt, out, len); } },
     { Functions_FUNC_SEND_IMG, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().sender_.rpc_send_image(r.msg.file, out, len); } },
     { Functions_FUNC_SEND_FILE, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().sender_.rpc_send_file(r.msg.file, out, len); } },
@@ -256,19 +397,39 @@ const std::unordered_map<Functions, RpcServer::FunctionHandler> RpcServer::rpcFu
     { Functions_FUNC_SEND_RICH_TXT, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().sender_.rpc_send_rich_text(r.msg.rt, out, len); } },
     { Functions_FUNC_SEND_PAT_MSG, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().sender_.rpc_send_pat(r.msg.pm, out, len); } },
     { Functions_FUNC_FORWARD_MSG, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().sender_.rpc_forward(r.msg.fm, out, len); } },
-    { Functions_FUNC_EXEC_DB_QUERY, [](const Request &r, uint8_t *out, size_t *len) { return db::rpc_exec_db_query(r.msg.query, out, len); } },
+    { Functions_FUNC_FORWARD_MSGS, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().sender_.rpc_forward_many(r.msg.mf, out, len); } },
+    { Functions_FUNC_SEND_PATS, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().sender_.rpc_send_pats(r.msg.mp, out, len); } },
+    { Functions_FUNC_UPLOAD_FILE, [](const Request &r, uint8_t *out, size_t *len) { return message::UploadStore::get_instance().rpc_write(r.msg.up, out, len); } },
+    { Functions_FUNC_GET_SEND_RESULT, [](const Request &r, uint8_t *out, size_t *len) { return message::SendQueue::get_instance().rpc_get_result(r.msg.ui64, out, len); } },
+    { Functions_FUNC_SET_SEND_LIMITS, [](const Request &r, uint8_t *out, size_t *len) { return message::SendQueue::get_instance().rpc_set_limits(r.msg.limits, out, len); } },
+    { Functions_FUNC_BROADCAST, [](const Request &r, uint8_t *out, size_t *len) { return message::SendQueue::get_instance().rpc_broadcast(r.msg.bc, out, len); } },
+    { Functions_FUNC_EXEC_DB_QUERY, [](const Request &r, uint8_t *out, size_t *len) { return db::rpc_exec_db_query(r.msg.query, r.mask, out, len); } },
+    { Functions_FUNC_EXEC_DB_ARROW, [](const Request &r, uint8_t *out, size_t *len) { return db::rpc_exec_db_query_arrow(r.msg.query, out, len); } },
     { Functions_FUNC_ACCEPT_FRIEND, [](const Request &r, uint8_t *out, size_t *len) { return contact::rpc_accept_friend(r.msg.v, out, len); } },
     { Functions_FUNC_RECV_TRANSFER, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_receive_transfer(r.msg.tf, out, len); } },
     { Functions_FUNC_REFRESH_PYQ, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_refresh_pyq(r.msg.ui64, out, len); } },
     { Functions_FUNC_DOWNLOAD_ATTACH, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_download_attachment(r.msg.att, out, len); } },
-    { Functions_FUNC_GET_CONTACT_INFO, [](const Request &r, uint8_t *out, size_t *len) { return contact::rpc_get_contact_info(r.msg.str, out, len); } },
+    { Functions_FUNC_DOWNLOAD_ASYNC, [](const Request &r, uint8_t *out, size_t *len) { return misc::DownloadManager::get_instance().rpc_submit(r.msg.att, out, len); } },
+    { Functions_FUNC_GET_DOWNLOAD, [](const Request &r, uint8_t *out, size_t *len) { return misc::DownloadManager::get_instance().rpc_query(r.msg.ui64, out, len); } },
+    { Functions_FUNC_CANCEL_DOWNLOAD, [](const Request &r, uint8_t *out, size_t *len) { return misc::DownloadManager::get_instance().rpc_cancel(r.msg.ui64, out, len); } },
+    { Functions_FUNC_SET_DOWNLOAD_LIMIT, [](const Request &r, uint8_t *out, size_t *len) { return misc::DownloadManager::get_instance().rpc_set_limits(r.msg.dl, out, len); } },
+    { Functions_FUNC_SET_PREFETCH, [](const Request &r, uint8_t *out, size_t *len) { return prefetch::rpc_set_policy(r.msg.pf, out, len); } },
+    { Functions_FUNC_GET_CONTACT_INFO, [](const Request &r, uint8_t *out, size_t *len) { return contact::rpc_get_contact_info(r.msg.str, r.mask, out, len); } },
+    { Functions_FUNC_RESOLVE_CONTACTS, [](const Request &r, uint8_t *out, size_t *len) { return contact::rpc_get_contacts_by_wxids(r.msg.str, r.mask, out, len); } },
+    { Functions_FUNC_GET_STATS, [](const Request &r, uint8_t *out, size_t *len) { return RpcServer::getInstance().rpc_get_stats(out, len); } },
     { Functions_FUNC_REVOKE_MSG, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_revoke_message(r.msg.ui64, out, len); } },
     { Functions_FUNC_REFRESH_QRCODE, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_get_login_url(out, len); } },
     { Functions_FUNC_DECRYPT_IMAGE, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_decrypt_image(r.msg.dec, out, len); } },
+    { Functions_FUNC_DECRYPT_IMAGES, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_decrypt_images(r.msg.db, out, len); } },
+    { Functions_FUNC_GET_DECRYPT, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_query_decrypt(r.msg.ui64, out, len); } },
+    { Functions_FUNC_READ_IMAGE, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_read_image(r.msg.dr, out, len); } },
+    { Functions_FUNC_SET_MEDIA_CACHE, [](const Request &r, uint8_t *out, size_t *len) { return misc::MediaCache::get_instance().rpc_configure(r.msg.cc, out, len); } },
     { Functions_FUNC_EXEC_OCR, [](const Request &r, uint8_t *out, size_t *len) { return misc::rpc_get_ocr_result(r.msg.str, out, len); } },
     { Functions_FUNC_ADD_ROOM_MEMBERS, [](const Request &r, uint8_t *out, size_t *len) { return chatroom::rpc_add_chatroom_member(r.msg.m, out, len); } },
     { Functions_FUNC_DEL_ROOM_MEMBERS, [](const Request &r, uint8_t *out, size_t *len) { return chatroom::rpc_delete_chatroom_member(r.msg.m, out, len); } },
     { Functions_FUNC_INV_ROOM_MEMBERS, [](const Request &r, uint8_t *out, size_t *len) { return chatroom::rpc_invite_chatroom_member(r.msg.m, out, len); } },
+    { Functions_FUNC_GET_ROOM_MEMBERS, [](const Request &r, uint8_t *out, size_t *len) { return chatroom::rpc_get_room_members(r.msg.str, out, len); } },
+    { Functions_FUNC_BATCH_ROOM_MEMBERS, [](const Request &r, uint8_t *out, size_t *len) { return chatroom::rpc_batch_room_members(r.msg.str, out, len); } },
     // clang-format on
 };
 
@@ -286,7 +447,9 @@ bool RpcServer::dispatcher(uint8_t *in, size_t in_len, uint8_t *out, size_t *out
     LOG_DEBUG("{:#04x}[{}] length: {}", (uint8_t)req.func, magic_enum::enum_name(req.func), in_len);
 
     auto it = RpcServer::rpcFunctionMap.find(req.func);
-    if (it != RpcServer::rpcFunctionMap.end()) {
+    if (req.async && message::SendQueue::is_send_func(req.func)) {
+        ret = message::SendQueue::get_instance().rpc_submit(req, out, out_len);
+    } else if (it != RpcServer::rpcFunctionMap.end()) {
         ret = it->second(req, out, out_len);
     } else {
         LOG_ERROR("[未知方法]");
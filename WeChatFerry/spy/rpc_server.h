@@ -29,8 +29,9 @@ private:
 
     void run_rpc_server();
     void on_message_callback();
-    bool start_message_listener(bool pyq, uint8_t *out, size_t *len);
+    bool start_message_listener(bool pyq, FieldMask_t mask, uint8_t *out, size_t *len);
     bool stop_message_listener(uint8_t *out, size_t *len);
+    bool rpc_get_stats(uint8_t *out, size_t *len);
     bool dispatcher(uint8_t *in, size_t in_len, uint8_t *out, size_t *out_len);
 
     static std::string build_url(int port);
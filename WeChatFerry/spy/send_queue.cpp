@@ -0,0 +1,504 @@
+﻿#include "send_queue.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "log.hpp"
+#include "media_registry.h"
+#include "message_handler.h"
+#include "message_sender.h"
+#include "rpc_helper.h"
+#include "upload_store.h"
+#include "util.h"
+
+namespace message
+{
+
+#define MAX_QUEUE_SIZE   1024
+#define MAX_RESULT_COUNT 4096
+
+static std::string to_string(const char *s) { return s ? s : ""; }
+
+static const char *class_name(size_t cls)
+{
+    switch (cls) {
+        case SendPriority_PRIORITY_INTERACTIVE:
+            return "interactive";
+        case SendPriority_PRIORITY_NORMAL:
+            return "normal";
+        default:
+            return "bulk";
+    }
+}
+
+static const char *type_name(Functions func)
+{
+    switch (func) {
+        case Functions_FUNC_SEND_TXT:
+            return "txt";
+        case Functions_FUNC_SEND_IMG:
+            return "img";
+        case Functions_FUNC_SEND_FILE:
+            return "file";
+        case Functions_FUNC_SEND_EMOTION:
+            return "emotion";
+        case Functions_FUNC_SEND_RICH_TXT:
+            return "rich_txt";
+        case Functions_FUNC_SEND_PAT_MSG:
+            return "pat";
+        case Functions_FUNC_FORWARD_MSG:
+            return "forward";
+        default:
+            return "other";
+    }
+}
+
+static uint32_t elapsed_ms(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count());
+}
+
+SendQueue &SendQueue::get_instance()
+{
+    static SendQueue instance;
+    return instance;
+}
+
+SendQueue::~SendQueue() { stop(); }
+
+bool SendQueue::is_send_func(Functions func)
+{
+    switch (func) {
+        case Functions_FUNC_SEND_TXT:
+        case Functions_FUNC_SEND_IMG:
+        case Functions_FUNC_SEND_FILE:
+        case Functions_FUNC_SEND_EMOTION:
+        case Functions_FUNC_SEND_RICH_TXT:
+        case Functions_FUNC_SEND_PAT_MSG:
+        case Functions_FUNC_FORWARD_MSG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint64_t SendQueue::submit(const Request &req)
+{
+    Job job { 0, req.func };
+    bool valid = false;
+    switch (req.func) {
+        case Functions_FUNC_SEND_TXT:
+            job.receiver = to_string(req.msg.txt.receiver);
+            job.content  = to_string(req.msg.txt.msg);
+            job.extra    = to_string(req.msg.txt.aters);
+            valid        = !job.content.empty();
+            break;
+        case Functions_FUNC_SEND_IMG:
+        case Functions_FUNC_SEND_FILE:
+        case Functions_FUNC_SEND_EMOTION:
+            job.receiver = to_string(req.msg.file.receiver);
+            job.content  = UploadStore::get_instance().resolve(to_string(req.msg.file.path));
+            valid        = !job.content.empty();
+            break;
+        case Functions_FUNC_SEND_RICH_TXT: {
+            const RichText &rt = req.msg.rt;
+            job.receiver       = to_string(rt.receiver);
+            valid              = true;
+            for (const char *field : { rt.name, rt.account, rt.title, rt.digest, rt.url, rt.thumburl }) {
+                job.rich.push_back(to_string(field));
+            }
+            break;
+        }
+        case Functions_FUNC_SEND_PAT_MSG:
+            job.receiver = to_string(req.msg.pm.roomid);
+            job.content  = to_string(req.msg.pm.wxid);
+            valid        = !job.content.empty();
+            break;
+        case Functions_FUNC_FORWARD_MSG:
+            job.receiver = to_string(req.msg.fm.receiver);
+            job.msgid    = req.msg.fm.id;
+            valid        = true;
+            break;
+        default:
+            break;
+    }
+
+    if (!valid || job.receiver.empty()) {
+        LOG_ERROR("Invalid async {} request", type_name(req.func));
+        return 0;
+    }
+
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = enqueue(std::move(job), req.priority, Clock::time_point());
+    }
+    cv_.notify_one();
+    return id;
+}
+
+std::vector<uint64_t> SendQueue::broadcast(const Broadcast &bc)
+{
+    std::vector<uint64_t> ids(bc.receivers_count, 0);
+    std::string content = to_string(bc.content);
+    if (content.empty() || (bc.func != Functions_FUNC_SEND_TXT && bc.func != Functions_FUNC_SEND_IMG
+                            && bc.func != Functions_FUNC_SEND_FILE && bc.func != Functions_FUNC_SEND_EMOTION)) {
+        LOG_ERROR("Invalid broadcast {}", type_name(bc.func));
+        return ids;
+    }
+
+    auto gap = std::chrono::milliseconds(bc.interval_ms);
+    if (bc.func != Functions_FUNC_SEND_TXT) {
+        // 上传句柄要保留到最后一条发出，按间隔和全局限速估算排队时长
+        auto spacing = gap;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            double rate = scheduler_.limits().globalRate;
+            auto cost   = costs_.find(bc.func);
+            if (rate > 0) {
+                double ms = 1000.0 * (cost == costs_.end() ? 1.0 : cost->second) / rate;
+                spacing   = std::max(spacing, std::chrono::milliseconds(static_cast<int64_t>(ms)));
+            }
+        }
+        content = UploadStore::get_instance().resolve(content, spacing * bc.receivers_count);
+        if (content.empty()) {
+            return ids;
+        }
+    }
+
+    // 图片、文件的路径在执行时才换成 MediaRegistry 的副本，这里只共享文本的宽字符内容
+    std::shared_ptr<const std::wstring> wide;
+    if (bc.func == Functions_FUNC_SEND_TXT) {
+        wide = std::make_shared<const std::wstring>(util::s2w(content));
+    }
+
+    auto now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t queued = 0;
+        for (pb_size_t i = 0; i < bc.receivers_count; i++) {
+            if (bc.receivers[i] == nullptr || bc.receivers[i][0] == '\0') {
+                continue;
+            }
+            Job job { 0, bc.func, bc.receivers[i] };
+            if (wide) {
+                job.wide = wide;
+            } else {
+                job.content = content;
+            }
+            ids[i] = enqueue(std::move(job), bc.priority, now + gap * queued);
+            if (ids[i] != 0) {
+                queued++;
+            }
+        }
+        LOG_INFO("Broadcast {} to {}/{} receivers", type_name(bc.func), queued, bc.receivers_count);
+    }
+    cv_.notify_one();
+    return ids;
+}
+
+uint64_t SendQueue::enqueue(Job &&job, size_t cls, Clock::time_point notBefore)
+{
+    if (stopped_) {
+        // stop() 放锁后才 join，这时重启会给还没 join 的 worker_ 赋值
+        LOG_WARN("Send queue is stopped, rejecting {}", type_name(job.func));
+        return 0;
+    }
+    if (jobs_.size() >= MAX_QUEUE_SIZE) {
+        rejected_++;
+        LOG_WARN("Send queue is full, rejecting {}", type_name(job.func));
+        return 0;
+    }
+
+    uint64_t id  = nextId_++;
+    job.id       = id;
+    job.queued   = Clock::now();
+    results_[id] = { id, job.func, job.receiver, SendResult_State_QUEUED, 0, 0, 0 };
+    resultOrder_.push_back(id);
+
+    auto cost = costs_.find(job.func);
+    scheduler_.push(id, cls, job.receiver, cost == costs_.end() ? 1.0 : cost->second, job.queued, notBefore);
+    jobs_.emplace(id, std::move(job));
+
+    if (!running_) {
+        running_ = true;
+        worker_  = std::thread(&SendQueue::run, this);
+    }
+    return id;
+}
+
+SendResult_t SendQueue::query(uint64_t job) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = results_.find(job);
+    if (it == results_.end()) {
+        return { job, Functions_FUNC_RESERVED, "", SendResult_State_UNKNOWN, 0, 0, 0 };
+    }
+    return it->second;
+}
+
+void SendQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+        for (uint64_t id : scheduler_.drain()) {
+            results_[id].state = SendResult_State_FAILED;
+        }
+        jobs_.clear();
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void SendQueue::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return !running_ || scheduler_.size() > 0; });
+        if (!running_) {
+            break;
+        }
+
+        // 全部在限速中时等到最早可发的时间，期间有新任务或配置变化会被唤醒
+        Clock::time_point wake;
+        uint64_t id = scheduler_.pop(Clock::now(), wake);
+        if (id == 0) {
+            cv_.wait_until(lock, std::min(wake, Clock::now() + std::chrono::seconds(1)));
+            continue;
+        }
+
+        auto it = jobs_.find(id);
+        Job job = std::move(it->second);
+        jobs_.erase(it);
+        results_[id].state = SendResult_State_RUNNING;
+        lock.unlock();
+
+        auto started = Clock::now();
+        bool ok      = false;
+        int status   = -1;
+        try {
+            status = execute(job, ok);
+        } catch (const std::exception &e) {
+            LOG_ERROR("Async {} to {} failed: {}", type_name(job.func), job.receiver, e.what());
+        }
+        finish(job, status, ok, started);
+        lock.lock();
+    }
+}
+
+int SendQueue::execute(const Job &job, bool &ok)
+{
+    auto &sender = Sender::get_instance();
+    int status   = 0;
+    switch (job.func) {
+        case Functions_FUNC_SEND_TXT:
+            if (job.wide) {
+                sender.send_text(job.receiver, *job.wide);
+            } else {
+                sender.send_text(job.receiver, job.content, job.extra);
+            }
+            break;
+        case Functions_FUNC_SEND_IMG:
+        case Functions_FUNC_SEND_FILE: {
+            // 算 md5、复制副本在发送线程做，不占 RPC 线程；群发时后面的接收人命中路径缓存，不再读文件
+            auto &registry = MediaRegistry::get_instance();
+            std::string key;
+            std::string path = registry.canonicalize(job.func, job.content, key);
+            ok               = registry.send(key, job.receiver, [&] {
+                if (job.func == Functions_FUNC_SEND_FILE) {
+                    return sender.send_file(job.receiver, path);
+                }
+                sender.send_image(job.receiver, path);
+                return true;
+            });
+            return ok ? 0 : -1;
+        }
+        case Functions_FUNC_SEND_EMOTION:
+            sender.send_emotion(job.receiver, job.content);
+            break;
+        case Functions_FUNC_SEND_RICH_TXT: {
+            RichText rt = RichText_init_default;
+            rt.name     = const_cast<char *>(job.rich[0].c_str());
+            rt.account  = const_cast<char *>(job.rich[1].c_str());
+            rt.title    = const_cast<char *>(job.rich[2].c_str());
+            rt.digest   = const_cast<char *>(job.rich[3].c_str());
+            rt.url      = const_cast<char *>(job.rich[4].c_str());
+            rt.thumburl = const_cast<char *>(job.rich[5].c_str());
+            rt.receiver = const_cast<char *>(job.receiver.c_str());
+            status      = sender.send_rich_text(rt);
+            ok          = status == 0;
+            return status;
+        }
+        case Functions_FUNC_SEND_PAT_MSG:
+            status = sender.send_pat(job.receiver, job.content);
+            ok     = status == 1;
+            return status;
+        case Functions_FUNC_FORWARD_MSG:
+            status = sender.forward(job.msgid, job.receiver);
+            ok     = status == 1;
+            return status;
+        default:
+            return -1;
+    }
+    ok = true;
+    return status;
+}
+
+void SendQueue::finish(const Job &job, int status, bool ok, Clock::time_point started)
+{
+    auto now = Clock::now();
+    auto us  = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - started).count());
+
+    SendResult_t result;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TypeStats &ts = typeStats_[job.func];
+        ts.count++;
+        if (!ok) {
+            ts.failed++;
+        }
+        ts.latencyTotal += us;
+        ts.latencyMax    = std::max(ts.latencyMax, us);
+
+        SendResult_t &r = results_[job.id];
+        r.state         = ok ? SendResult_State_DONE : SendResult_State_FAILED;
+        r.status        = status;
+        r.wait_ms       = elapsed_ms(job.queued, started);
+        r.run_ms        = elapsed_ms(started, now);
+        result          = r;
+
+        // 只淘汰已结束的结果，排队和执行中的任务总能查到
+        while (results_.size() > MAX_RESULT_COUNT && !resultOrder_.empty()) {
+            auto it = results_.find(resultOrder_.front());
+            if (it != results_.end() && it->second.state <= SendResult_State_RUNNING) {
+                break;
+            }
+            if (it != results_.end()) {
+                results_.erase(it);
+            }
+            resultOrder_.pop_front();
+        }
+    }
+
+    auto &handler = Handler::getInstance();
+    if (handler.isMessageListening()) {
+        WxMsg_t msg = {};
+        msg.type    = SEND_RESULT_MSG_TYPE;
+        msg.ts      = static_cast<uint32_t>(time(nullptr));
+        msg.sent    = std::move(result);
+        handler.pushMessage(std::move(msg));
+    }
+}
+
+void SendQueue::collect_stats(Stats_t &stats) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats["sendq.depth"]     = jobs_.size();
+    stats["sendq.submitted"] = nextId_ - 1;
+    stats["sendq.rejected"]  = rejected_;
+    for (const auto &[func, ts] : typeStats_) {
+        std::string prefix                 = std::string("sendq.") + type_name(func) + ".";
+        stats[prefix + "count"]            = ts.count;
+        stats[prefix + "failed"]           = ts.failed;
+        stats[prefix + "latency_total_us"] = ts.latencyTotal;
+        stats[prefix + "latency_max_us"]   = ts.latencyMax;
+    }
+    for (size_t cls = 0; cls < SendScheduler::CLASS_COUNT; cls++) {
+        const auto &cs                  = scheduler_.stats(cls);
+        std::string prefix              = std::string("sendq.class.") + class_name(cls) + ".";
+        stats[prefix + "queued"]        = scheduler_.size(cls);
+        stats[prefix + "served"]        = cs.served;
+        stats[prefix + "throttled"]     = cs.throttled;
+        stats[prefix + "wait_total_us"] = cs.waitTotal;
+        stats[prefix + "wait_max_us"]   = cs.waitMax;
+    }
+}
+
+int SendQueue::set_limits(const SendLimits &limits)
+{
+    SendScheduler::Limits l;
+    l.globalRate    = limits.global_rate;
+    l.globalBurst   = limits.global_burst;
+    l.receiverRate  = limits.receiver_rate;
+    l.receiverBurst = limits.receiver_burst;
+    for (pb_size_t i = 0; i < limits.weights_count && i < l.weights.size(); i++) {
+        if (limits.weights[i] <= 0) {
+            LOG_ERROR("Invalid weight for priority {}: {}", i, limits.weights[i]);
+            return -1;
+        }
+        l.weights[i] = limits.weights[i];
+    }
+
+    std::map<Functions, double> costs;
+    for (pb_size_t i = 0; i < limits.costs_count; i++) {
+        if (!is_send_func(limits.costs[i].func) || limits.costs[i].cost < 0) {
+            LOG_ERROR("Invalid send cost for {}", static_cast<int>(limits.costs[i].func));
+            return -1;
+        }
+        costs[limits.costs[i].func] = limits.costs[i].cost;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        scheduler_.configure(l);
+        costs_ = std::move(costs);
+    }
+    cv_.notify_all();
+    LOG_INFO("Send limits: global {}/s burst {}, receiver {}/s burst {}", l.globalRate, l.globalBurst, l.receiverRate,
+             l.receiverBurst);
+    return 0;
+}
+
+bool SendQueue::rpc_submit(const Request &req, uint8_t *out, size_t *len)
+{
+    uint64_t job = submit(req);
+    // 响应的 func 与请求一致，成功时返回任务 id，失败时返回 status -1
+    return fill_response<Functions_FUNC_GET_SEND_RESULT>(out, len, [&](Response &rsp) {
+        rsp.func = req.func;
+        if (job == 0) {
+            rsp.which_msg  = Response_status_tag;
+            rsp.msg.status = -1;
+        } else {
+            rsp.which_msg = Response_job_tag;
+            rsp.msg.job   = job;
+        }
+    });
+}
+
+bool SendQueue::rpc_set_limits(const SendLimits &limits, uint8_t *out, size_t *len)
+{
+    return fill_response<Functions_FUNC_SET_SEND_LIMITS>(out, len,
+                                                          [&](Response &rsp) { rsp.msg.status = set_limits(limits); });
+}
+
+bool SendQueue::rpc_broadcast(const Broadcast &bc, uint8_t *out, size_t *len)
+{
+    std::vector<uint64_t> ids = broadcast(bc);
+    return fill_response<Functions_FUNC_BROADCAST>(out, len, [&](Response &rsp) {
+        rsp.msg.jobs.ids_count = static_cast<pb_size_t>(ids.size());
+        rsp.msg.jobs.ids       = ids.data();
+    });
+}
+
+bool SendQueue::rpc_get_result(uint64_t job, uint8_t *out, size_t *len)
+{
+    SendResult_t result = query(job);
+    return fill_response<Functions_FUNC_GET_SEND_RESULT>(out, len, [&](Response &rsp) {
+        rsp.msg.sent.job      = result.job;
+        rsp.msg.sent.func     = static_cast<Functions>(result.func);
+        rsp.msg.sent.receiver = const_cast<char *>(result.receiver.c_str());
+        rsp.msg.sent.state    = static_cast<SendResult_State>(result.state);
+        rsp.msg.sent.status   = result.status;
+        rsp.msg.sent.wait_ms  = result.wait_ms;
+        rsp.msg.sent.run_ms   = result.run_ms;
+    });
+}
+
+} // namespace message
@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "wcf.pb.h"
+
+#include "pb_types.h"
+#include "send_scheduler.h"
+
+namespace message
+{
+
+// 异步发送结果的消息类型
+constexpr uint32_t SEND_RESULT_MSG_TYPE = 0x10001;
+
+// 异步发送队列：RPC 线程只入队并返回任务 id，发送线程按 SendScheduler 的限速和优先级执行
+// 完成后结果以 SEND_RESULT_MSG_TYPE 消息推送（需开启消息接收），也可用 FUNC_GET_SEND_RESULT 查询
+class SendQueue
+{
+public:
+    static SendQueue &get_instance();
+
+    // 是否为可异步执行的发送函数；XML 发送未启用（rpc_send_xml 总是返回 -1），不在其中
+    static bool is_send_func(Functions func);
+
+    // 复制参数入队，参数无效或队列已满返回 0
+    uint64_t submit(const Request &req);
+
+    // 同一内容发给多个接收人，内容只转换一次；返回与接收人一一对应的任务 id，0 为未入队
+    std::vector<uint64_t> broadcast(const Broadcast &bc);
+    SendResult_t query(uint64_t job) const;
+
+    // 整体替换限速、各发送函数的令牌消耗和优先级权重，对排队中的任务立即生效
+    int set_limits(const SendLimits &limits);
+    void stop();
+    void collect_stats(Stats_t &stats) const;
+
+    // RPC 方法
+    bool rpc_submit(const Request &req, uint8_t *out, size_t *len);
+    bool rpc_get_result(uint64_t job, uint8_t *out, size_t *len);
+    bool rpc_set_limits(const SendLimits &limits, uint8_t *out, size_t *len);
+    bool rpc_broadcast(const Broadcast &bc, uint8_t *out, size_t *len);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job {
+        uint64_t id;
+        Functions func;
+        std::string receiver; // 拍一拍为群 id
+        std::string content;  // 文本、文件路径，拍一拍为 wxid，@ 列表在 extra
+        std::string extra;
+        uint64_t msgid = 0;
+        std::vector<std::string> rich; // 卡片消息的 name, account, title, digest, url, thumburl
+        std::shared_ptr<const std::wstring> wide; // 群发文本时共享的宽字符内容，优先于 content
+        Clock::time_point queued;
+    };
+
+    struct TypeStats {
+        uint64_t count        = 0;
+        uint64_t failed       = 0;
+        uint64_t latencyTotal = 0; // 执行耗时，微秒
+        uint64_t latencyMax   = 0;
+    };
+
+    SendQueue() = default;
+    ~SendQueue();
+
+    SendQueue(const SendQueue &)            = delete;
+    SendQueue &operator=(const SendQueue &) = delete;
+
+    uint64_t enqueue(Job &&job, size_t cls, Clock::time_point notBefore); // 调用方持有 mutex_
+    void run();
+    int execute(const Job &job, bool &ok);
+    void finish(const Job &job, int status, bool ok, Clock::time_point started);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<uint64_t, Job> jobs_;
+    SendScheduler scheduler_;
+    std::map<Functions, double> costs_;
+    std::unordered_map<uint64_t, SendResult_t> results_;
+    std::deque<uint64_t> resultOrder_;
+    std::map<Functions, TypeStats> typeStats_;
+    std::thread worker_;
+    bool running_      = false;
+    bool stopped_      = false; // stop() 之后不再接受任务
+    uint64_t nextId_   = 1;
+    uint64_t rejected_ = 0;
+};
+
+} // namespace message
@@ -0,0 +1,170 @@
+﻿#include "send_scheduler.h"
+
+#include <algorithm>
+
+namespace message
+{
+
+#define MAX_RECEIVER_COUNT 4096
+
+void SendScheduler::configure(const Limits &limits)
+{
+    limits_ = limits;
+    for (double &w : limits_.weights) {
+        w = std::max(w, 0.001);
+    }
+}
+
+void SendScheduler::push(uint64_t id, size_t cls, const std::string &receiver, double cost, Clock::time_point now,
+                         Clock::time_point notBefore)
+{
+    Class &c = classes_[std::min(cls, CLASS_COUNT - 1)];
+    if (c.count == 0) {
+        c.pass = std::max(c.pass, vtime_); // 空闲期间不积累份额
+    }
+    auto &q = c.queues[receiver];
+    if (q.empty()) {
+        c.ring.push_back(receiver);
+    }
+    q.push_back({ id, std::max(cost, 0.0), now, notBefore });
+    c.count++;
+
+    if (receivers_.size() > MAX_RECEIVER_COUNT) {
+        prune_buckets(now);
+    }
+}
+
+// 补充令牌，够支付 cost 时返回 true；不够时 ready 为补足的时间
+bool SendScheduler::refill(Bucket &b, double rate, double burst, double cost, Clock::time_point now,
+                           Clock::time_point &ready)
+{
+    if (rate <= 0) {
+        return true;
+    }
+
+    double cap = std::max(burst, cost);
+    if (b.tokens < 0) {
+        b.tokens = cap;
+    } else {
+        b.tokens = std::min(cap, b.tokens + std::chrono::duration<double>(now - b.last).count() * rate);
+    }
+    b.last = now;
+
+    if (b.tokens >= cost) {
+        return true;
+    }
+    auto lack = std::chrono::duration<double>((cost - b.tokens) / rate);
+    ready     = now + std::chrono::ceil<Clock::duration>(lack); // 向上取整，避免醒来时仍差一点点
+    return false;
+}
+
+uint64_t SendScheduler::pop(Clock::time_point now, Clock::time_point &wake)
+{
+    wake = Clock::time_point::max();
+
+    std::array<size_t, CLASS_COUNT> order;
+    for (size_t i = 0; i < CLASS_COUNT; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [this](size_t a, size_t b) { return classes_[a].pass < classes_[b].pass; });
+
+    for (size_t cls : order) {
+        Class &c = classes_[cls];
+        // 每个接收者只看队首：等待或限速中的接收者轮到队尾，它后面的任务不插队，也不挡别的接收者
+        for (size_t n = c.ring.size(); n > 0; n--) {
+            std::string receiver = std::move(c.ring.front());
+            c.ring.pop_front();
+            auto &q  = c.queues[receiver];
+            Entry &e = q.front();
+
+            Clock::time_point ready;
+            bool waiting = e.notBefore > now;
+            if (waiting) {
+                ready = e.notBefore;
+            } else if (!refill(receivers_[receiver], limits_.receiverRate, limits_.receiverBurst, e.cost, now, ready)) {
+                waiting = true;
+                if (!e.delayed) {
+                    e.delayed = true;
+                    c.stats.throttled++;
+                }
+            }
+            if (waiting) {
+                wake = std::min(wake, ready);
+                c.ring.push_back(std::move(receiver));
+                continue;
+            }
+
+            // 全局限速时按公平顺序等待，不让后面的任务插队
+            if (!refill(global_, limits_.globalRate, limits_.globalBurst, e.cost, now, ready)) {
+                wake = std::min(wake, ready);
+                if (!e.delayed) {
+                    e.delayed = true;
+                    c.stats.throttled++;
+                }
+                c.ring.push_front(std::move(receiver));
+                return 0;
+            }
+
+            if (limits_.receiverRate > 0) receivers_[receiver].tokens -= e.cost;
+            if (limits_.globalRate > 0) global_.tokens -= e.cost;
+
+            vtime_ = c.pass;
+            c.pass += e.cost / limits_.weights[cls];
+
+            auto wait = std::chrono::duration_cast<std::chrono::microseconds>(now - e.queued);
+            auto us   = static_cast<uint64_t>(wait.count());
+            c.stats.served++;
+            c.stats.waitTotal += us;
+            c.stats.waitMax = std::max(c.stats.waitMax, us);
+
+            uint64_t id = e.id;
+            q.pop_front();
+            c.count--;
+            if (q.empty()) {
+                c.queues.erase(receiver);
+            } else {
+                c.ring.push_back(std::move(receiver));
+            }
+            return id;
+        }
+    }
+    return 0;
+}
+
+std::vector<uint64_t> SendScheduler::drain()
+{
+    std::vector<uint64_t> ids;
+    for (Class &c : classes_) {
+        for (const auto &receiver : c.ring) {
+            for (const Entry &e : c.queues[receiver]) {
+                ids.push_back(e.id);
+            }
+        }
+        c.queues.clear();
+        c.ring.clear();
+        c.count = 0;
+    }
+    return ids;
+}
+
+size_t SendScheduler::size() const
+{
+    size_t n = 0;
+    for (const Class &c : classes_) {
+        n += c.count;
+    }
+    return n;
+}
+
+// 丢掉已经补满的接收者令牌桶，重新使用时仍从满桶开始，结果不变
+void SendScheduler::prune_buckets(Clock::time_point now)
+{
+    double rate = limits_.receiverRate;
+    for (auto it = receivers_.begin(); it != receivers_.end();) {
+        bool full = rate <= 0 || it->second.tokens < 0
+                 || it->second.tokens + std::chrono::duration<double>(now - it->second.last).count() * rate
+                        >= limits_.receiverBurst;
+        it = full ? receivers_.erase(it) : std::next(it);
+    }
+}
+
+} // namespace message
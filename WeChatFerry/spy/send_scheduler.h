@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace message
+{
+
+// 发送调度：全局和按接收者的令牌桶限速，不同优先级按权重公平出队（stride scheduling）
+// 同一优先级内每个接收者一个队列，保持提交顺序，各接收者轮流出队，限速中的接收者不挡别人
+// 本身不加锁，由 SendQueue 持锁调用
+class SendScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t CLASS_COUNT = 3; // 对应 SendPriority
+
+    struct Limits {
+        double globalRate    = 0; // 每秒令牌数，0 为不限
+        double globalBurst   = 0; // 桶容量，小于单次消耗时按单次消耗算
+        double receiverRate  = 0;
+        double receiverBurst = 0;
+        std::array<double, CLASS_COUNT> weights { 8, 3, 1 };
+    };
+
+    struct ClassStats {
+        uint64_t served    = 0;
+        uint64_t throttled = 0; // 因限速推迟过的任务数
+        uint64_t waitTotal = 0; // 排队耗时，微秒
+        uint64_t waitMax   = 0;
+    };
+
+    void configure(const Limits &limits);
+    const Limits &limits() const { return limits_; }
+
+    // notBefore 之前不出队，也不让同一接收者后面的任务插队
+    void push(uint64_t id, size_t cls, const std::string &receiver, double cost, Clock::time_point now,
+              Clock::time_point notBefore = {});
+
+    // 取下一个可执行的任务；都在限速中时返回 0，wake 为最早可能可执行的时间
+    uint64_t pop(Clock::time_point now, Clock::time_point &wake);
+
+    // 清空并返回所有未执行的任务
+    std::vector<uint64_t> drain();
+
+    size_t size() const;
+    size_t size(size_t cls) const { return classes_[cls].count; }
+    const ClassStats &stats(size_t cls) const { return classes_[cls].stats; }
+
+private:
+    struct Entry {
+        uint64_t id;
+        double cost;
+        Clock::time_point queued;
+        Clock::time_point notBefore;
+        bool delayed = false;
+    };
+
+    struct Bucket {
+        double tokens = -1; // -1 为未初始化，首次使用时为满桶
+        Clock::time_point last;
+    };
+
+    struct Class {
+        std::unordered_map<std::string, std::deque<Entry>> queues; // 接收者 -> 任务，只保留有任务的接收者
+        std::deque<std::string> ring;                              // 有任务的接收者，从头开始轮流尝试
+        size_t count = 0;
+        double pass  = 0; // 虚拟时间，每次出队增加 cost / weight
+        ClassStats stats;
+    };
+
+    static bool refill(Bucket &b, double rate, double burst, double cost, Clock::time_point now,
+                       Clock::time_point &ready);
+    void prune_buckets(Clock::time_point now);
+
+    Limits limits_;
+    std::array<Class, CLASS_COUNT> classes_;
+    double vtime_ = 0; // 最近出队的优先级的虚拟时间，新进入排队的优先级从这里开始
+    Bucket global_;
+    std::unordered_map<std::string, Bucket> receivers_;
+};
+
+} // namespace message
@@ -0,0 +1,70 @@
+﻿#include "silk_packets.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "codec.h"
+
+namespace misc
+{
+
+static constexpr char SILK_MAGIC[]     = "#!SILK_V3";
+static constexpr size_t SILK_MAGIC_LEN = sizeof(SILK_MAGIC) - 1;
+static constexpr uint16_t SILK_END     = 0xFFFF;
+static constexpr size_t WARMUP_FRAMES  = 5;
+
+bool split_silk(const std::vector<uint8_t> &silk, SilkPackets &packets)
+{
+    packets    = {};
+    size_t pos = 0;
+    if (!silk.empty() && silk[0] == 0x02) { // 没经过 get_audio_data 的原始数据带一个 0x02
+        pos = 1;
+    }
+    if (silk.size() < pos + SILK_MAGIC_LEN || memcmp(silk.data() + pos, SILK_MAGIC, SILK_MAGIC_LEN) != 0) {
+        return false;
+    }
+
+    pos += SILK_MAGIC_LEN;
+    packets.header = pos;
+    while (pos + 2 <= silk.size()) {
+        uint16_t n = static_cast<uint16_t>(silk[pos] | (silk[pos + 1] << 8));
+        if (n == SILK_END || pos + 2 + n > silk.size()) {
+            break; // 结束标记或者被截断的包
+        }
+        packets.offsets.push_back(pos);
+        pos += 2 + n;
+    }
+    packets.offsets.push_back(pos);
+    return true;
+}
+
+std::vector<uint8_t> slice_silk(const std::vector<uint8_t> &silk, const SilkPackets &packets, size_t begin, size_t end)
+{
+    end   = std::min(end, packets.count());
+    begin = std::min(begin, end);
+
+    std::vector<uint8_t> out;
+    out.reserve(packets.header + packets.offsets[end] - packets.offsets[begin]);
+    out.insert(out.end(), silk.begin(), silk.begin() + packets.header);
+    out.insert(out.end(), silk.begin() + packets.offsets[begin], silk.begin() + packets.offsets[end]);
+    return out;
+}
+
+std::vector<uint8_t> decode_silk_range(const std::vector<uint8_t> &silk, const SilkPackets &packets, size_t begin,
+                                       size_t end, int32_t sr)
+{
+    // 解码器每次调用都从头初始化，从中间开始会有爆音，先多解几个包再把这部分丢掉
+    size_t warmup = std::min(begin, WARMUP_FRAMES);
+    auto data     = slice_silk(silk, packets, begin - warmup, end);
+    std::vector<uint8_t> pcm;
+    SilkDecode(data, pcm, sr);
+    if (warmup > 0) {
+        auto head = slice_silk(silk, packets, begin - warmup, begin);
+        std::vector<uint8_t> skip;
+        SilkDecode(head, skip, sr);
+        pcm.erase(pcm.begin(), pcm.begin() + std::min(skip.size(), pcm.size()));
+    }
+    return pcm;
+}
+
+} // namespace misc
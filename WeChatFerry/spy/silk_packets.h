@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace misc
+{
+
+// 语音数据为 #!SILK_V3 头加若干个包，每包 2 字节小端长度加数据，一包 20ms
+struct SilkPackets {
+    size_t header = 0;           // 头部长度
+    std::vector<size_t> offsets; // 每个包（含长度字段）的起始位置，末尾多放一个结束位置
+    size_t count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+};
+
+bool split_silk(const std::vector<uint8_t> &silk, SilkPackets &packets);
+
+// 取出 [begin, end) 这几个包，拼成能单独解码的 SILK 数据
+std::vector<uint8_t> slice_silk(const std::vector<uint8_t> &silk, const SilkPackets &packets, size_t begin,
+                                size_t end);
+
+// 解码 [begin, end) 这几个包为 16 位 PCM；前面多解几个包预热解码器，输出时丢掉
+// 按顺序分块解码再拼接，与整条解码的长度一致，块边界处只有预热带来的细微差异
+std::vector<uint8_t> decode_silk_range(const std::vector<uint8_t> &silk, const SilkPackets &packets, size_t begin,
+                                       size_t end, int32_t sr);
+
+} // namespace misc
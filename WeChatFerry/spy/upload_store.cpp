@@ -0,0 +1,368 @@
+﻿#include "upload_store.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <random>
+
+#include "log.hpp"
+#include "rpc_helper.h"
+
+namespace message
+{
+namespace fs = std::filesystem;
+
+#define MAX_UPLOAD_SIZE (1ULL << 30) // 微信发送文件的上限
+#define MAX_SESSIONS    64
+
+static constexpr auto SESSION_IDLE = std::chrono::minutes(10);
+static constexpr auto HANDLE_TTL   = std::chrono::hours(1);
+static constexpr auto USE_GRACE    = std::chrono::minutes(10); // 发送后微信可能还在读文件
+static constexpr auto GC_INTERVAL  = std::chrono::seconds(30);
+
+// 只保留文件名部分，去掉 Windows 文件名里不允许的字符
+static std::string safe_name(const char *name)
+{
+    std::string s = name ? name : "";
+    size_t slash  = s.find_last_of("/\\");
+    if (slash != std::string::npos) {
+        s = s.substr(slash + 1);
+    }
+
+    std::string out;
+    for (char c : s) {
+        if (static_cast<unsigned char>(c) < 0x20 || strchr("<>:\"|?*", c) != nullptr) {
+            continue;
+        }
+        out.push_back(c);
+    }
+    while (!out.empty() && (out.back() == '.' || out.back() == ' ')) { // Windows 会去掉结尾的点和空格
+        out.pop_back();
+    }
+    return out;
+}
+
+static bool parse_md5(const char *in, std::string &md5)
+{
+    md5 = in ? in : "";
+    std::transform(md5.begin(), md5.end(), md5.begin(), [](unsigned char c) { return std::tolower(c); });
+    return md5.empty()
+        || (md5.size() == 32 && std::all_of(md5.begin(), md5.end(), [](unsigned char c) { return isxdigit(c); }));
+}
+
+UploadStore &UploadStore::get_instance()
+{
+    static UploadStore instance;
+    return instance;
+}
+
+UploadStore::UploadStore() : lastGc_(Clock::now())
+{
+    std::error_code ec;
+    dir_ = fs::temp_directory_path(ec) / "WeChatFerry" / "upload";
+}
+
+bool UploadStore::prepare()
+{
+    if (ready_) {
+        return true;
+    }
+
+    // 句柄不跨进程，上次留下的内容都作废
+    std::error_code ec;
+    fs::remove_all(dir_, ec);
+    fs::create_directories(dir_ / ".parts", ec);
+    if (ec) {
+        LOG_ERROR("创建上传目录失败: {}, {}", dir_.string(), ec.message());
+        return false;
+    }
+    ready_ = true;
+    return true;
+}
+
+std::string UploadStore::new_handle()
+{
+    static std::mt19937_64 rng(std::random_device {}());
+    std::string handle;
+    do {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(rng() ^ ++seq_));
+        handle = std::string(UPLOAD_HANDLE_PREFIX) + buf;
+    } while (sessions_.count(handle) || handles_.count(handle));
+    return handle;
+}
+
+UploadState_t UploadStore::write(const UploadChunk &chunk)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    gc(now);
+    if (!prepare()) {
+        return { -5, "", 0, false };
+    }
+
+    std::string handle = chunk.handle ? chunk.handle : "";
+    if (handle.empty()) {
+        return begin(chunk, now);
+    }
+
+    auto done = handles_.find(handle);
+    if (done != handles_.end()) { // 已经传完，重发最后一块时照样返回完成
+        return { 0, handle, blobs_[done->second.md5].size, true };
+    }
+    auto it = sessions_.find(handle);
+    if (it == sessions_.end()) {
+        return { -2, handle, 0, false };
+    }
+    it->second.touched = now;
+    return append(handle, it->second, chunk);
+}
+
+UploadState_t UploadStore::begin(const UploadChunk &chunk, Clock::time_point now)
+{
+    std::string name = safe_name(chunk.name);
+    std::string md5;
+    if (name.empty() || chunk.size == 0 || chunk.size > MAX_UPLOAD_SIZE || !parse_md5(chunk.md5, md5)) {
+        LOG_ERROR("上传参数错误: {}, {} bytes", chunk.name ? chunk.name : "", chunk.size);
+        rejected_++;
+        return { -1, "", 0, false };
+    }
+
+    // 相同内容已经在暂存目录里，不用再传
+    auto blob = md5.empty() ? blobs_.end() : blobs_.find(md5);
+    if (blob != blobs_.end() && blob->second.size == chunk.size) {
+        std::string handle = new_handle();
+        if (!attach(handle, md5, name)) {
+            return { -5, "", 0, false };
+        }
+        dedupHits_++;
+        return { 0, handle, chunk.size, true };
+    }
+
+    if (sessions_.size() >= MAX_SESSIONS) {
+        LOG_ERROR("同时上传的文件太多: {}", sessions_.size());
+        rejected_++;
+        return { -1, "", 0, false };
+    }
+
+    std::string handle = new_handle();
+    Session s;
+    s.name    = name;
+    s.size    = chunk.size;
+    s.md5     = md5;
+    s.part    = dir_ / ".parts" / (handle.substr(strlen(UPLOAD_HANDLE_PREFIX)) + ".part");
+    s.touched = now;
+    s.out     = std::make_unique<std::ofstream>(s.part, std::ios::binary | std::ios::trunc);
+    if (!*s.out) {
+        LOG_ERROR("创建上传文件失败: {}", s.part.string());
+        return { -5, "", 0, false };
+    }
+
+    Session &ref = sessions_.emplace(handle, std::move(s)).first->second;
+    if (chunk.data && chunk.data->size > 0) { // 小文件可以一次传完
+        return append(handle, ref, chunk);
+    }
+    return { 0, handle, 0, false };
+}
+
+UploadState_t UploadStore::append(const std::string &handle, Session &s, const UploadChunk &chunk)
+{
+    if (chunk.offset != s.received) { // 丢块或重发，客户端从 received 处续传
+        return { -3, handle, s.received, false };
+    }
+
+    size_t n = chunk.data ? chunk.data->size : 0;
+    if (n > s.size - s.received) {
+        LOG_ERROR("上传内容超出声明的大小: {}, {} > {}", handle, s.received + n, s.size);
+        rejected_++;
+        drop_session(handle);
+        return { -4, handle, 0, false };
+    }
+
+    if (n > 0) {
+        s.out->write(reinterpret_cast<const char *>(chunk.data->bytes), n);
+        if (!*s.out) {
+            LOG_ERROR("写入上传文件失败: {}", s.part.string());
+            drop_session(handle);
+            return { -5, handle, 0, false };
+        }
+        s.hash.update(chunk.data->bytes, n);
+        s.received += n;
+        received_ += n;
+    }
+
+    if (s.received < s.size) {
+        return { 0, handle, s.received, false };
+    }
+    return finish(handle, s);
+}
+
+UploadState_t UploadStore::finish(const std::string &handle, Session &s)
+{
+    s.out->close();
+    if (s.out->fail()) {
+        LOG_ERROR("写入上传文件失败: {}", s.part.string());
+        drop_session(handle);
+        return { -5, handle, 0, false };
+    }
+
+    std::string md5 = s.hash.hex_digest();
+    if (!s.md5.empty() && s.md5 != md5) {
+        LOG_ERROR("上传内容校验失败: {}, {} != {}", handle, md5, s.md5);
+        rejected_++;
+        drop_session(handle);
+        return { -4, handle, 0, false };
+    }
+
+    fs::path part    = s.part;
+    std::string name = s.name;
+    uint64_t size    = s.size;
+    sessions_.erase(handle);
+
+    std::error_code ec;
+    if (blobs_.count(md5) == 0) {
+        fs::path dir = dir_ / md5;
+        fs::create_directories(dir, ec);
+        fs::rename(part, dir / fs::u8path(name), ec);
+        if (ec) {
+            LOG_ERROR("保存上传文件失败: {}, {}", name, ec.message());
+            fs::remove(part, ec);
+            fs::remove_all(dir, ec);
+            return { -5, handle, 0, false };
+        }
+        blobs_[md5] = { dir, size };
+        bytes_ += size;
+    } else {
+        fs::remove(part, ec); // 传完才发现已有相同内容
+        dedupHits_++;
+    }
+
+    if (!attach(handle, md5, name)) {
+        return { -5, handle, 0, false };
+    }
+    completed_++;
+    return { 0, handle, size, true };
+}
+
+bool UploadStore::attach(const std::string &handle, const std::string &md5, const std::string &name)
+{
+    Blob &blob    = blobs_[md5];
+    fs::path path = blob.dir / fs::u8path(name);
+
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        fs::path src;
+        for (auto it = fs::directory_iterator(blob.dir, ec); !ec && it != fs::directory_iterator(); ++it) {
+            src = it->path();
+            break;
+        }
+        fs::create_hard_link(src, path, ec);
+        if (ec) {
+            ec.clear();
+            fs::copy_file(src, path, ec);
+        }
+        if (ec) {
+            LOG_ERROR("创建上传文件失败: {}, {}", name, ec.message());
+            return false;
+        }
+    }
+
+    blob.refs++;
+    handles_[handle] = { md5, path, Clock::now() + HANDLE_TTL };
+    return true;
+}
+
+void UploadStore::drop_session(const std::string &handle)
+{
+    auto it = sessions_.find(handle);
+    if (it == sessions_.end()) {
+        return;
+    }
+    it->second.out.reset();
+    std::error_code ec;
+    fs::remove(it->second.part, ec);
+    sessions_.erase(it);
+}
+
+void UploadStore::gc(Clock::time_point now)
+{
+    if (now - lastGc_ < GC_INTERVAL) {
+        return;
+    }
+    lastGc_ = now;
+
+    for (auto it = sessions_.begin(); it != sessions_.end();) {
+        auto cur = it++;
+        if (now - cur->second.touched >= SESSION_IDLE) {
+            expired_++;
+            drop_session(cur->first);
+        }
+    }
+
+    std::error_code ec;
+    for (auto it = handles_.begin(); it != handles_.end();) {
+        if (it->second.expires > now) {
+            ++it;
+            continue;
+        }
+        auto blob = blobs_.find(it->second.md5);
+        if (blob != blobs_.end() && --blob->second.refs == 0) {
+            fs::remove_all(blob->second.dir, ec);
+            bytes_ -= blob->second.size;
+            blobs_.erase(blob);
+        }
+        expired_++;
+        it = handles_.erase(it);
+    }
+}
+
+std::string UploadStore::resolve(const std::string &ref, std::chrono::milliseconds hold)
+{
+    if (ref.compare(0, strlen(UPLOAD_HANDLE_PREFIX), UPLOAD_HANDLE_PREFIX) != 0) {
+        return ref;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    gc(now);
+    auto it = handles_.find(ref);
+    if (it == handles_.end()) {
+        LOG_ERROR("上传句柄无效或已过期: {}", ref);
+        return "";
+    }
+
+    // 没用过的按创建时间过期，用过的从最后一次使用算起
+    Handle &h  = it->second;
+    auto until = now + USE_GRACE + hold;
+    h.expires  = h.used ? std::max(h.expires, until) : until;
+    h.used     = true;
+    return h.path.u8string();
+}
+
+void UploadStore::collect_stats(Stats_t &stats)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    gc(Clock::now());
+    stats["upload.sessions"]   = sessions_.size();
+    stats["upload.handles"]    = handles_.size();
+    stats["upload.blobs"]      = blobs_.size();
+    stats["upload.bytes"]      = bytes_;
+    stats["upload.received"]   = received_;
+    stats["upload.completed"]  = completed_;
+    stats["upload.dedup_hits"] = dedupHits_;
+    stats["upload.rejected"]   = rejected_;
+    stats["upload.expired"]    = expired_;
+}
+
+bool UploadStore::rpc_write(const UploadChunk &chunk, uint8_t *out, size_t *len)
+{
+    UploadState_t state = write(chunk);
+    return fill_response<Functions_FUNC_UPLOAD_FILE>(out, len, [&](Response &rsp) {
+        rsp.msg.up.status   = state.status;
+        rsp.msg.up.handle   = const_cast<char *>(state.handle.c_str());
+        rsp.msg.up.received = state.received;
+        rsp.msg.up.done     = state.done;
+    });
+}
+
+} // namespace message
@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "wcf.pb.h"
+
+#include "md5.h"
+#include "pb_types.h"
+
+namespace message
+{
+
+// 上传句柄的前缀，发送图片、文件、表情时 path 以它开头就按句柄解析
+constexpr const char *UPLOAD_HANDLE_PREFIX = "upload:";
+
+// 分块上传：客户端把文件分块写到本机的暂存目录，传完校验大小和 md5 后得到句柄，发送函数用句柄代替路径
+// 内容按 md5 去重，同一份内容只存一份、只传一次；句柄未使用 1 小时后过期，用过后 10 分钟内没再用就回收
+class UploadStore
+{
+public:
+    static UploadStore &get_instance();
+
+    UploadState_t write(const UploadChunk &chunk);
+
+    // 不是句柄时原样返回；句柄无效、过期或未传完返回空串
+    // 每次解析都会续期，hold 为还要保留多久（如群发排队的时长）
+    std::string resolve(const std::string &ref, std::chrono::milliseconds hold = std::chrono::milliseconds(0));
+
+    void collect_stats(Stats_t &stats);
+
+    // RPC 方法
+    bool rpc_write(const UploadChunk &chunk, uint8_t *out, size_t *len);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // 正在上传的文件
+    struct Session {
+        std::string name;
+        uint64_t size;
+        std::string md5; // 客户端给的，传完后校验
+        uint64_t received = 0;
+        std::filesystem::path part;
+        std::unique_ptr<std::ofstream> out;
+        util::Md5 hash;
+        Clock::time_point touched;
+    };
+
+    // 去重后的内容，目录下按文件名各有一个硬链接
+    struct Blob {
+        std::filesystem::path dir;
+        uint64_t size;
+        size_t refs = 0;
+    };
+
+    struct Handle {
+        std::string md5;
+        std::filesystem::path path;
+        Clock::time_point expires;
+        bool used = false;
+    };
+
+    UploadStore();
+
+    UploadStore(const UploadStore &)            = delete;
+    UploadStore &operator=(const UploadStore &) = delete;
+
+    // 以下调用方需持有 mutex_
+    bool prepare();
+    UploadState_t begin(const UploadChunk &chunk, Clock::time_point now);
+    UploadState_t append(const std::string &handle, Session &s, const UploadChunk &chunk);
+    UploadState_t finish(const std::string &handle, Session &s);
+    // 给内容加一个句柄，文件名不同时在内容目录里建硬链接
+    bool attach(const std::string &handle, const std::string &md5, const std::string &name);
+    std::string new_handle();
+    void drop_session(const std::string &handle);
+    void gc(Clock::time_point now);
+
+    std::mutex mutex_;
+    std::filesystem::path dir_;
+    bool ready_ = false;
+    std::unordered_map<std::string, Session> sessions_;
+    std::unordered_map<std::string, Blob> blobs_; // md5 -> 内容
+    std::unordered_map<std::string, Handle> handles_;
+    Clock::time_point lastGc_;
+    uint64_t seq_       = 0;
+    uint64_t bytes_     = 0; // 暂存目录里去重后的内容大小
+    uint64_t received_  = 0;
+    uint64_t completed_ = 0;
+    uint64_t dedupHits_ = 0;
+    uint64_t rejected_  = 0;
+    uint64_t expired_   = 0;
+};
+
+} // namespace message